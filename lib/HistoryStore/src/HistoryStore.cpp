@@ -0,0 +1,561 @@
+#include "HistoryStore.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_rom_crc.h"
+#endif
+
+uint32_t storeCrc32(uint32_t crc, const void *data, size_t len) {
+#ifdef ESP_PLATFORM
+  return esp_rom_crc32_le(crc, (const uint8_t *)data, len);
+#else
+  const uint8_t *p = (const uint8_t *)data;
+  crc = ~crc;
+  while (len--) {
+    crc ^= *p++;
+    for (int k = 0; k < 8; k++)
+      crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+  }
+  return ~crc;
+#endif
+}
+
+// ---- Packed samples ----
+
+static int32_t clampRound(float v, int32_t lo, int32_t hi) {
+  int32_t r = lroundf(v);
+  return r < lo ? lo : (r > hi ? hi : r);
+}
+
+PackedSample packSample(const SensorData &data, uint32_t prevTime) {
+  PackedSample ps;
+  ps.centiDegrees = clampRound(data.temperature * 100.0f, INT16_MIN, INT16_MAX);
+  ps.humidity = clampRound(data.humidity * 100.0f, 0, UINT16_MAX);
+  ps.deciHpa = clampRound(data.pressure * 10.0f, 0, UINT16_MAX);
+  ps.dt = (uint16_t)((uint32_t)data.timestamp - prevTime);
+  return ps;
+}
+
+SensorData unpackSample(const PackedSample &ps, uint32_t timestamp) {
+  SensorData data;
+  data.temperature = ps.centiDegrees / 100.0f;
+  data.humidity = ps.humidity / 100.0f;
+  data.pressure = ps.deciHpa / 10.0f;
+  data.timestamp = (time_t)timestamp;
+  return data;
+}
+
+uint32_t historySamplesCrc(uint32_t crc, const PackedSample *samples,
+                           uint8_t n) {
+  return storeCrc32(crc, samples, n * sizeof(PackedSample));
+}
+
+uint32_t historyHeaderCrc(uint32_t samplesCrc, const HistoryBlockHeader &h) {
+  return storeCrc32(samplesCrc, &h, sizeof(h) - sizeof(h.crc)); // crc is last
+}
+
+bool historyBlockValid(const HistoryBlock &b) {
+  return b.hdr.count <= HISTORY_BLOCK_SAMPLES &&
+         historyHeaderCrc(historySamplesCrc(0, b.samples, b.hdr.count),
+                          b.hdr) == b.hdr.crc;
+}
+
+// ---- SegmentLog ----
+
+namespace {
+
+struct SegmentScan {
+  uint32_t lo;
+  uint32_t hi;
+  uint32_t hiBytes;
+};
+
+void scanSegment(const char *name, uint32_t size, void *ctx) {
+  SegmentScan &scan = *(SegmentScan *)ctx;
+  if (strlen(name) != 8)
+    return; // meta, tail
+  char *end;
+  uint32_t seg = strtoul(name, &end, 16);
+  if (*end != '\0')
+    return;
+  if (seg < scan.lo)
+    scan.lo = seg;
+  if (seg >= scan.hi) {
+    scan.hi = seg;
+    scan.hiBytes = size;
+  }
+}
+
+// remove() collects names rather than deleting from inside list(): neither
+// LittleFS nor RamStorage promises a listing survives its entries going away
+struct NameBatch {
+  static const int MAX = 8;
+  char names[MAX][LOG_PATH_MAX];
+  int count;
+};
+
+void collectName(const char *name, uint32_t, void *ctx) {
+  NameBatch &batch = *(NameBatch *)ctx;
+  if (batch.count < NameBatch::MAX) {
+    strncpy(batch.names[batch.count], name, LOG_PATH_MAX - 1);
+    batch.names[batch.count][LOG_PATH_MAX - 1] = '\0';
+    batch.count++;
+  }
+}
+
+} // namespace
+
+bool SegmentLog::mount() {
+  if (state.crc == stateCrc())
+    return true;
+  partialSlot = false;
+  LogMeta meta;
+  if (!readMeta(meta) || !matches(meta))
+    return false;
+  SegmentScan scan = {UINT32_MAX, 0, 0};
+  if (!fs.list(spec.dir, scanSegment, &scan))
+    return false;
+  if (scan.lo == UINT32_MAX)
+    scan.lo = scan.hi = 0; // created, nothing appended yet
+  partialSlot = scan.hiBytes % spec.slotBytes != 0;
+  commit(scan.lo, scan.hi * segmentSlots() + scan.hiBytes / spec.slotBytes);
+  return true;
+}
+
+bool SegmentLog::readMeta(LogMeta &meta) {
+  char p[LOG_PATH_MAX];
+  path("meta", p);
+  int h = fs.open(p, Storage::READ);
+  if (h < 0)
+    return false;
+  bool ok = fs.read(h, 0, &meta, sizeof(meta)) == sizeof(meta);
+  fs.close(h);
+  return ok;
+}
+
+bool SegmentLog::create() {
+  fs.mkdir(spec.dir);
+  char p[LOG_PATH_MAX];
+  path("meta", p);
+  LogMeta meta = {spec.magic, spec.version, 0, spec.slotBytes, spec.layout, 0};
+  int h = fs.open(p, Storage::REPLACE);
+  if (h < 0)
+    return false;
+  bool ok = fs.write(h, &meta, sizeof(meta)) == sizeof(meta);
+  fs.close(h);
+  if (!ok)
+    return false;
+  partialSlot = false;
+  commit(0, 0);
+  return true;
+}
+
+void SegmentLog::remove() {
+  forget();
+  char p[LOG_PATH_MAX];
+  NameBatch batch;
+  int removed;
+  do {
+    batch.count = 0;
+    if (!fs.list(spec.dir, collectName, &batch))
+      return;
+    removed = 0;
+    for (int i = 0; i < batch.count; i++) {
+      path(batch.names[i], p);
+      removed += fs.remove(p);
+    }
+  } while (removed > 0);
+  fs.rmdir(spec.dir);
+}
+
+bool SegmentLog::repair() {
+  if (!partialSlot)
+    return true;
+  char seg[LOG_PATH_MAX], tmp[LOG_PATH_MAX];
+  segmentPath(state.nextSlot / segmentSlots(), seg);
+  path("tmp", tmp);
+  int in = fs.open(seg, Storage::READ);
+  int out = fs.open(tmp, Storage::REPLACE);
+  uint8_t buf[256];
+  uint32_t left = (state.nextSlot % segmentSlots()) * spec.slotBytes;
+  uint32_t offset = 0;
+  bool ok = in >= 0 && out >= 0;
+  while (ok && left > 0) {
+    size_t n = left < sizeof(buf) ? left : sizeof(buf);
+    ok = fs.read(in, offset, buf, n) == n && fs.write(out, buf, n) == n;
+    offset += n;
+    left -= n;
+  }
+  fs.close(in);
+  fs.close(out);
+  ok = ok && fs.remove(seg) && fs.rename(tmp, seg);
+  partialSlot = !ok;
+  return ok;
+}
+
+void SegmentLog::path(const char *name, char *out) const {
+  snprintf(out, LOG_PATH_MAX, "%s/%s", spec.dir, name);
+}
+
+void SegmentLog::segmentPath(uint32_t seg, char *out) const {
+  snprintf(out, LOG_PATH_MAX, "%s/%08lx", spec.dir, (unsigned long)seg);
+}
+
+void SegmentLog::commit(uint32_t firstSegment, uint32_t nextSlot) {
+  state.firstSegment = firstSegment;
+  state.nextSlot = nextSlot;
+  state.crc = stateCrc();
+}
+
+bool SegmentLog::matches(const LogMeta &m) const {
+  return m.magic == spec.magic && m.version == spec.version &&
+         m.slotBytes == spec.slotBytes && m.layout == spec.layout;
+}
+
+// The layout goes into the CRC too, so a firmware built with another
+// channel set never trusts bookkeeping left in RTC memory by this one
+uint32_t SegmentLog::stateCrc() const {
+  return storeCrc32(spec.magic ^ spec.layout, &state,
+                    sizeof(state) - sizeof(state.crc));
+}
+
+// ---- LogCursor / LogWriter ----
+
+size_t LogCursor::read(SegmentLog &log, uint32_t slot, void *buf, size_t len) {
+  uint32_t perSeg = log.segmentSlots();
+  uint32_t seg = slot / perSeg;
+  if (file < 0 || owner != &log || seg != fileSegment) {
+    close();
+    char p[LOG_PATH_MAX];
+    log.segmentPath(seg, p);
+    owner = &log;
+    fs = &log.fs;
+    file = fs->open(p, Storage::READ);
+    if (file < 0)
+      return 0;
+    fileSegment = seg;
+  }
+  uint32_t offset = (slot % perSeg) * log.spec.slotBytes;
+  if (len > LOG_SEGMENT_BYTES - offset)
+    len = LOG_SEGMENT_BYTES - offset;
+  return fs->read(file, offset, buf, len);
+}
+
+void LogCursor::close() {
+  if (file >= 0)
+    fs->close(file);
+  file = -1;
+}
+
+bool LogWriter::open(SegmentLog &target) {
+  if (log)
+    return true;
+  LogMeta foreign;
+  if (!target.mount() &&
+      ((target.exists() && target.readMeta(foreign)) || !target.create()))
+    return false;
+  if (target.partial() && !target.repair())
+    return false;
+  log = &target;
+  first = target.firstSegment();
+  next = target.endSlot();
+  evictions = 0;
+  failed = false;
+  return true;
+}
+
+bool LogWriter::append(const void *rec) {
+  if (!log || failed)
+    return false;
+  Storage &fs = log->fs;
+  uint32_t perSeg = log->segmentSlots();
+  uint32_t seg = next / perSeg;
+  if (file < 0 || seg != fileSegment) {
+    if (file >= 0)
+      fs.close(file);
+    char p[LOG_PATH_MAX];
+    if (next % perSeg == 0) {
+      // Starting a segment: rotate out the oldest beyond the budget
+      while (seg - first + 1 > log->maxSegments()) {
+        log->segmentPath(first++, p);
+        fs.remove(p);
+        evictions += perSeg;
+      }
+    }
+    log->segmentPath(seg, p);
+    file = fs.open(p, Storage::APPEND);
+    if (file < 0) {
+      failed = true;
+      return false;
+    }
+    fileSegment = seg;
+  }
+  if (fs.write(file, rec, log->spec.slotBytes) != log->spec.slotBytes) {
+    failed = true; // a fragment may be on flash; mount() finds it
+    return false;
+  }
+  next++;
+  return true;
+}
+
+void LogWriter::close() {
+  if (!log)
+    return;
+  if (file >= 0)
+    log->fs.close(file);
+  file = -1;
+  if (failed)
+    log->forget();
+  else
+    log->commit(first, next);
+  log = nullptr;
+}
+
+// ---- History log ----
+
+TailState historyLoadTail(SegmentLog &log, LogCursor &cursor, uint32_t first,
+                          uint32_t full, HistoryBlock &tail, uint32_t &next) {
+  next = 0;
+  if (full > 0) {
+    HistoryBlockHeader last;
+    if (cursor.read(log, first + full - 1, &last, sizeof(last)) !=
+        sizeof(last))
+      return TAIL_ERROR;
+    next = last.firstIndex + last.count;
+  }
+  char p[LOG_PATH_MAX];
+  log.path("tail", p);
+  int h = log.fs.open(p, Storage::READ);
+  if (h < 0)
+    return TAIL_NONE;
+  bool got = log.fs.read(h, 0, &tail, sizeof(tail)) == sizeof(tail);
+  log.fs.close(h);
+  if (!got || !historyBlockValid(tail))
+    return TAIL_BAD;
+  if (tail.hdr.count == 0)
+    return TAIL_NONE;
+  if (full > 0 && tail.hdr.firstIndex < next)
+    return TAIL_STALE;
+  return full == 0 || tail.hdr.firstIndex == next ? TAIL_OK : TAIL_BAD;
+}
+
+bool HistoryReader::open() {
+  if (opened)
+    return true;
+  if (!log.fs.mount() || !log.mount())
+    return false;
+  first = log.firstSlot();
+  full = log.size();
+  entries = 0;
+  cachedBlock = UINT32_MAX;
+  uint32_t next;
+  TailState ts = historyLoadTail(log, cursor, first, full, tail, next);
+  if (ts == TAIL_ERROR) {
+    cursor.close();
+    return false;
+  }
+  blocks = full + (ts == TAIL_OK ? 1 : 0);
+  opened = true;
+  HistoryBlockHeader oldest, newest;
+  if (blocks > 0 && readHeader(0, oldest) && readHeader(blocks - 1, newest)) {
+    baseIndex = oldest.firstIndex;
+    entries = newest.firstIndex + newest.count - baseIndex;
+  }
+  return true;
+}
+
+void HistoryReader::close() {
+  cursor.close();
+  opened = false;
+  blocks = 0;
+  entries = 0;
+  cachedBlock = UINT32_MAX;
+}
+
+bool HistoryReader::read(uint32_t index, SensorData &out) {
+  if (index >= entries || !opened)
+    return false;
+  uint32_t seq = baseIndex + index;
+  if (!inCachedBlock(seq) && !locate(seq))
+    return false;
+  uint32_t i = seq - block.hdr.firstIndex;
+  out = unpackSample(block.samples[i], sampleTimes[i]);
+  log.fs.stats.records++;
+  return true;
+}
+
+uint32_t HistoryReader::lowerBound(time_t t) {
+  if (entries == 0 || !opened)
+    return 0;
+  uint32_t lo = 0;
+  uint32_t hi = blocks;
+  HistoryBlockHeader h;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (!readHeader(mid, h))
+      return entries;
+    if ((time_t)h.baseTime <= t)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == 0)
+    return 0; // t is before the oldest entry
+  if (!loadBlock(lo - 1))
+    return entries;
+  for (uint8_t i = 0; i < block.hdr.count; i++) {
+    if ((time_t)sampleTimes[i] >= t)
+      return block.hdr.firstIndex + i - baseIndex;
+  }
+  return block.hdr.firstIndex + block.hdr.count - baseIndex;
+}
+
+bool HistoryReader::readHeader(uint32_t b, HistoryBlockHeader &out) {
+  if (b == cachedBlock || b == full) {
+    out = b == cachedBlock ? block.hdr : tail.hdr;
+    return true;
+  }
+  return cursor.read(log, first + b, &out, sizeof(out)) == sizeof(out);
+}
+
+// A block that fails its CRC reads as missing rather than as garbage
+bool HistoryReader::loadBlock(uint32_t b) {
+  if (b == cachedBlock)
+    return true;
+  if (b == full) {
+    block = tail;
+  } else if (cursor.read(log, first + b, &block, sizeof(block)) !=
+                 sizeof(block) ||
+             !historyBlockValid(block)) {
+    cachedBlock = UINT32_MAX;
+    return false;
+  }
+  cacheBlock(b);
+  return true;
+}
+
+// Resolve the delta-coded timestamps of the block just read
+void HistoryReader::cacheBlock(uint32_t b) {
+  uint32_t t = block.hdr.baseTime;
+  for (uint8_t i = 0; i < block.hdr.count; i++) {
+    t += block.samples[i].dt;
+    sampleTimes[i] = t;
+  }
+  cachedBlock = b;
+}
+
+// Blocks are almost always full, so seq / HISTORY_BLOCK_SAMPLES (or the
+// neighbour of the cached block during a scan) is usually right on the first
+// read; otherwise binary-search the blocks by firstIndex.
+bool HistoryReader::locate(uint32_t seq) {
+  uint32_t guess = (seq - baseIndex) / HISTORY_BLOCK_SAMPLES;
+  if (cachedBlock != UINT32_MAX) {
+    if (seq == block.hdr.firstIndex + block.hdr.count)
+      guess = cachedBlock + 1;
+    else if (seq + 1 == block.hdr.firstIndex && cachedBlock > 0)
+      guess = cachedBlock - 1;
+  }
+  if (guess < blocks && loadBlock(guess) && inCachedBlock(seq))
+    return true;
+
+  uint32_t lo = 0;
+  uint32_t hi = blocks;
+  while (hi - lo > 1) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (!loadBlock(mid))
+      return false;
+    if (block.hdr.firstIndex <= seq)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return loadBlock(lo) && inCachedBlock(seq);
+}
+
+bool HistoryWriter::open() {
+  if (log.isOpen())
+    return true;
+  if (!log.open(target))
+    return false;
+  LogCursor cursor;
+  uint32_t next;
+  TailState ts = historyLoadTail(target, cursor, target.firstSlot(),
+                                 target.size(), tail, next);
+  if (ts == TAIL_ERROR) {
+    log.close();
+    return false;
+  }
+  trimmed = ts == TAIL_BAD;
+  trimmedCount =
+      trimmed && tail.hdr.count <= HISTORY_BLOCK_SAMPLES ? tail.hdr.count : 0;
+  if (ts == TAIL_OK) {
+    samplesCrc = historySamplesCrc(0, tail.samples, tail.hdr.count);
+    lastTime = tail.hdr.baseTime;
+    for (uint8_t i = 0; i < tail.hdr.count; i++) {
+      lastTime += tail.samples[i].dt;
+    }
+    tailDirty = false;
+  } else {
+    startTail(next);
+    tailDirty = ts != TAIL_NONE; // replace the file the readers skip
+  }
+  return true;
+}
+
+bool HistoryWriter::append(const SensorData &data) {
+  if (!log.isOpen())
+    return false;
+  uint32_t ts = (uint32_t)data.timestamp;
+  bool fits = tail.hdr.count < HISTORY_BLOCK_SAMPLES && ts >= lastTime &&
+              ts - lastTime <= UINT16_MAX;
+  if (tail.hdr.count > 0 && !fits && !sealTail())
+    return false;
+  if (tail.hdr.count == 0)
+    tail.hdr.baseTime = lastTime = ts;
+
+  PackedSample &ps = tail.samples[tail.hdr.count];
+  ps = packSample(data, lastTime);
+  samplesCrc = historySamplesCrc(samplesCrc, &ps, 1);
+  lastTime = ts;
+  tail.hdr.count++;
+  tailDirty = true;
+  return true;
+}
+
+bool HistoryWriter::close() {
+  if (!log.isOpen())
+    return true;
+  log.close();
+  return !tailDirty || writeTail();
+}
+
+void HistoryWriter::startTail(uint32_t firstIndex) {
+  tail = {};
+  tail.hdr.firstIndex = firstIndex;
+  samplesCrc = 0;
+}
+
+bool HistoryWriter::sealTail() {
+  tail.hdr.crc = historyHeaderCrc(samplesCrc, tail.hdr);
+  if (!log.append(&tail))
+    return false;
+  startTail(tail.hdr.firstIndex + tail.hdr.count);
+  return true;
+}
+
+bool HistoryWriter::writeTail() {
+  tail.hdr.crc = historyHeaderCrc(samplesCrc, tail.hdr);
+  char p[LOG_PATH_MAX];
+  target.path("tail", p);
+  int h = target.fs.open(p, Storage::REPLACE);
+  if (h < 0)
+    return false;
+  bool ok = target.fs.write(h, &tail, sizeof(tail)) == sizeof(tail);
+  target.fs.close(h);
+  tailDirty = !ok;
+  return ok;
+}
@@ -0,0 +1,415 @@
+#pragma once
+
+// Packed sensor history and the segmented logs behind it. Everything here
+// goes through a Storage, so the same code runs on LittleFS on the device
+// and on RamStorage in the native tests (pio test -e native).
+
+#include "Storage.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define HISTORY_MAGIC 0x4C484D52 // "RMHL"
+#define HISTORY_VERSION 2
+#define HISTORY_BLOCK_SAMPLES 30 // 16 B header + 30 * 8 B samples = 256 B
+#define HISTORY_READ_BLOCK 32 // records fetched per flash read by RecordReader
+#define LOG_SEGMENT_BYTES 8192 // two LittleFS blocks per segment file
+#define LOG_PATH_MAX 32
+
+struct SensorData {
+  float temperature;
+  float humidity;
+  float pressure;
+  time_t timestamp;
+};
+
+// CRC-32 (IEEE, as zlib), continuable: crc32(crc32(0, a), b) covers a + b.
+// The ROM routine on ESP32 targets, a bitwise loop elsewhere.
+uint32_t storeCrc32(uint32_t crc, const void *data, size_t len);
+
+// ---- Segmented append-only logs (history blocks, rollup records) ----
+// LittleFS files are copy-on-write: writing into the middle of a file
+// rewrites it from that point to the end, and only appends are cheap. So a
+// log is a directory of segment files, each packed with up to
+// LOG_SEGMENT_BYTES / slotBytes fixed-size slots and named by its segment
+// number in hex; slot s (numbered from the log's creation) is record
+// s % segmentSlots of segment s / segmentSlots. Records are only ever
+// appended, to the newest segment, and a segment is never reopened once the
+// next one starts. Retention is by rotation: when a new segment would make
+// more than capacity / segmentSlots + 1 of them, the oldest file is deleted.
+// A `meta` file written at creation identifies the layout; nothing else
+// describes the log, so there is no header to rewrite. The oldest and next
+// slot numbers come from listing the directory, once after a cold boot, and
+// are kept in RTC memory (LogState) between wakes.
+struct LogMeta {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t reserved;
+  uint16_t slotBytes;
+  uint32_t layout; // must match to open, e.g. the rollup channel set
+  uint32_t reserved2;
+};
+
+struct LogSpec {
+  const char *dir;
+  uint32_t magic;
+  uint8_t version;
+  uint16_t slotBytes;
+  uint32_t capacity; // slots guaranteed to survive a rotation
+  uint32_t layout;
+};
+
+// An aggregate so the firmware can keep it in RTC_DATA_ATTR memory; only
+// trusted while crc matches, so a cold boot rescans the directory
+struct LogState {
+  uint32_t firstSegment; // oldest segment file still on flash
+  uint32_t nextSlot;     // slot number the next append gets
+  uint32_t crc;
+};
+
+// ---- Packed history format (history log, version 2) ----
+// A segmented log of fixed 256-byte blocks. Each block holds
+// up to HISTORY_BLOCK_SAMPLES fixed-point samples whose timestamps are 16-bit
+// second deltas from the previous sample (the first one from the block's
+// base time, normally 0). A block is closed early when the next delta would
+// not fit (gap > 18 h or clock stepped back), so entry i is located through
+// the blocks' firstIndex rather than by arithmetic alone.
+//
+// Every block is a journal entry: firstIndex is its sequence number (each
+// block continues where the previous one ended) and crc seals the header
+// together with the samples it counts. Only full blocks go into the log, each
+// appended once and never touched again. The block still filling up lives
+// in the small `tail` file of the log directory, replaced whole on every
+// flush; LittleFS keeps a file that small inline in its metadata, so the
+// rewrite costs a metadata commit rather than a data block copy. Readers
+// trust the tail file only if it passes its CRC and continues the last
+// logged block.
+struct HistoryBlockHeader {
+  uint32_t firstIndex; // history index of samples[0], the block sequence
+  uint32_t baseTime;   // UTC epoch of samples[0]
+  uint8_t count;       // samples in use
+  uint8_t reserved[3];
+  uint32_t crc; // samples[0..count) then the header up to here
+};
+
+struct PackedSample {
+  int16_t centiDegrees; // temperature * 100
+  uint16_t humidity;    // %RH * 100
+  uint16_t deciHpa;     // pressure * 10
+  uint16_t dt;          // seconds since the previous sample (or baseTime)
+};
+
+// Self-contained record for the serial export and batch upload: absolute
+// epoch plus the stored sample fields (dt always 0)
+struct ExportRecord {
+  uint32_t timestamp;
+  PackedSample sample;
+};
+
+struct HistoryBlock {
+  HistoryBlockHeader hdr;
+  PackedSample samples[HISTORY_BLOCK_SAMPLES];
+};
+
+static_assert(sizeof(LogMeta) == 16, "log meta layout");
+static_assert(sizeof(PackedSample) == 8, "packed sample layout");
+static_assert(sizeof(HistoryBlockHeader) == 16, "history block header layout");
+static_assert(sizeof(HistoryBlock) == 256, "history block layout");
+static_assert(sizeof(ExportRecord) == 12, "export record layout");
+
+// dt is taken relative to prevTime: the previous sample in the block (the
+// base time for the first), or the sample's own time for an ExportRecord
+PackedSample packSample(const SensorData &data, uint32_t prevTime);
+SensorData unpackSample(const PackedSample &ps, uint32_t timestamp);
+
+// CRC of a block's samples, continued over its header without the crc field.
+// The samples go first so a writer can keep a running CRC as it appends and
+// only finish it with the header when the block is committed.
+uint32_t historySamplesCrc(uint32_t crc, const PackedSample *samples,
+                           uint8_t n);
+uint32_t historyHeaderCrc(uint32_t samplesCrc, const HistoryBlockHeader &h);
+bool historyBlockValid(const HistoryBlock &b);
+
+// ---- Segmented logs ----
+
+// One log's spec plus its bookkeeping. Slot numbers are absolute (they keep
+// counting across rotations); callers index from firstSlot().
+class SegmentLog {
+public:
+  SegmentLog(Storage &fs, const LogSpec &spec, LogState &state)
+      : fs(fs), spec(spec), state(state) {}
+
+  // True if the directory holds a log of this spec's layout. Lists the
+  // directory only when the bookkeeping failed its CRC.
+  bool mount();
+  bool exists() { return fs.exists(spec.dir); }
+  // Read the meta file of whatever log is in the directory
+  bool readMeta(LogMeta &meta);
+  bool create();
+  // Delete every file of the log and the directory itself
+  void remove();
+  // Copy the whole slots of the newest segment over it, dropping the
+  // fragment a failed append left, so the next append starts on a slot
+  // boundary. Rare: LittleFS only commits a file's size on close.
+  bool repair();
+  void path(const char *name, char *out) const;
+  void segmentPath(uint32_t seg, char *out) const;
+
+  uint32_t segmentSlots() const { return LOG_SEGMENT_BYTES / spec.slotBytes; }
+  uint32_t maxSegments() const {
+    return (spec.capacity + segmentSlots() - 1) / segmentSlots() + 1;
+  }
+  uint32_t firstSegment() const { return state.firstSegment; }
+  uint32_t firstSlot() const { return state.firstSegment * segmentSlots(); }
+  uint32_t endSlot() const { return state.nextSlot; }
+  uint32_t size() const { return endSlot() - firstSlot(); }
+  bool partial() const { return partialSlot; }
+
+  void commit(uint32_t firstSegment, uint32_t nextSlot);
+  // Rescan on the next mount(), e.g. after the files changed underneath
+  void forget() { state.crc = ~stateCrc(); }
+
+  Storage &fs;
+  const LogSpec &spec;
+
+private:
+  bool matches(const LogMeta &m) const;
+  uint32_t stateCrc() const;
+
+  LogState &state;
+  bool partialSlot = false;
+};
+
+// Read side: keeps the segment last read open, so a scan reopens once per
+// segment (every LOG_SEGMENT_BYTES) rather than per record
+class LogCursor {
+public:
+  ~LogCursor() { close(); }
+
+  // Read up to len bytes starting at absolute slot `slot`, stopping at the
+  // end of its segment; returns the bytes read
+  size_t read(SegmentLog &log, uint32_t slot, void *buf, size_t len);
+  void close();
+
+private:
+  const SegmentLog *owner = nullptr;
+  Storage *fs = nullptr;
+  int file = -1;
+  uint32_t fileSegment = 0;
+};
+
+// Write side, kept open for a whole batch. Records go to the newest segment
+// as plain sequential writes on one open file (no seeks), so LittleFS only
+// ever extends the file; close() commits them and the bookkeeping together.
+class LogWriter {
+public:
+  ~LogWriter() { close(); }
+
+  // Create the log if the directory doesn't exist; false if it holds a log
+  // of another layout (the caller migrates it first)
+  bool open(SegmentLog &target);
+  bool isOpen() const { return log != nullptr; }
+  bool append(const void *rec);
+  void close();
+
+  uint32_t size() const {
+    return log ? next - first * log->segmentSlots() : 0;
+  }
+  // Slots whose segment was deleted by this writer
+  uint32_t evicted() const { return evictions; }
+
+private:
+  SegmentLog *log = nullptr;
+  int file = -1;
+  uint32_t fileSegment = 0;
+  uint32_t first = 0; // oldest segment
+  uint32_t next = 0;  // next slot
+  uint32_t evictions = 0;
+  bool failed = false;
+};
+
+// Cursor over a log of fixed-size records; index 0 is the oldest retained.
+// The bounds are taken at open(), so a writer appending meanwhile doesn't
+// move them. Records are served from a HISTORY_READ_BLOCK-sized read-ahead
+// buffer, so a sequential scan costs one read() per block instead of an
+// open/seek/read/close per record.
+template <typename T> class RecordReader {
+public:
+  explicit RecordReader(SegmentLog &log) : log(log) {}
+  ~RecordReader() { close(); }
+
+  bool open() {
+    if (opened)
+      return true;
+    if (!log.fs.mount() || !log.mount())
+      return false;
+    first = log.firstSlot();
+    entries = log.size();
+    blockCount = 0;
+    opened = true;
+    return true;
+  }
+
+  void close() {
+    cursor.close();
+    opened = false;
+    entries = 0;
+    blockCount = 0;
+  }
+
+  bool isOpen() { return opened; }
+  uint32_t size() const { return entries; }
+
+  bool read(uint32_t index, T &out) {
+    if (index >= entries || !opened)
+      return false;
+    if (blockCount == 0 || index < blockStart ||
+        index >= blockStart + blockCount) {
+      if (!fill(index))
+        return false;
+    }
+    out = block[index - blockStart];
+    log.fs.stats.records++;
+    return true;
+  }
+
+private:
+  // Load the block containing index. Forward misses read ahead from index;
+  // a miss just below the cached block (scrolling back) reads the block that
+  // ends at index so the next steps backwards hit. A block never straddles
+  // two segment files.
+  bool fill(uint32_t index) {
+    uint32_t start = index;
+    if (blockCount > 0 && index < blockStart)
+      start = index >= HISTORY_READ_BLOCK - 1 ? index - (HISTORY_READ_BLOCK - 1)
+                                              : 0;
+    uint32_t segStart = index - (first + index) % log.segmentSlots();
+    if (start < segStart)
+      start = segStart; // index's segment begins after start
+    uint32_t n = entries - start;
+    if (n > HISTORY_READ_BLOCK)
+      n = HISTORY_READ_BLOCK;
+    size_t got = cursor.read(log, first + start, block, n * sizeof(T));
+    blockStart = start;
+    blockCount = got / sizeof(T);
+    return index >= blockStart && index < blockStart + blockCount;
+  }
+
+  SegmentLog &log;
+  LogCursor cursor;
+  bool opened = false;
+  uint32_t first = 0; // absolute slot of index 0
+  uint32_t entries = 0;
+  uint32_t blockStart = 0;
+  uint32_t blockCount = 0;
+  T block[HISTORY_READ_BLOCK];
+};
+
+// ---- History log ----
+
+// How the tail file stands against the logged blocks
+enum TailState {
+  TAIL_NONE,  // no tail file, or an empty one
+  TAIL_OK,    // continues the last logged block
+  TAIL_STALE, // already logged: a flush was cut off before replacing it
+  TAIL_BAD,   // failed its CRC or breaks the sequence
+  TAIL_ERROR  // the last logged block couldn't be read
+};
+
+// Tail recovery, shared by reader and writer. Logged blocks are appended
+// once and never rewritten, and LittleFS commits each append atomically on
+// close; the tail file is the only record a flush replaces, so it alone is
+// checked (CRC, and firstIndex continuing the last logged block), making
+// mount cost two small reads however long the history. `full` logged blocks
+// start at absolute slot `first`; `next` receives the sequence number the
+// tail has to start at.
+TailState historyLoadTail(SegmentLog &log, LogCursor &cursor, uint32_t first,
+                          uint32_t full, HistoryBlock &tail, uint32_t &next);
+
+// Cursor over the packed history; index 0 is the oldest entry still
+// retained. Keeps the current segment open for the whole query and caches
+// one 256-byte block, so a sequential scan costs one read() per
+// HISTORY_BLOCK_SAMPLES entries. The trusted tail file is read once at
+// open() and served as the last block.
+class HistoryReader {
+public:
+  explicit HistoryReader(SegmentLog &log) : log(log) {}
+  ~HistoryReader() { close(); }
+
+  // False if there is no log yet (or one in an older format)
+  bool open();
+  void close();
+  bool isOpen() { return opened; }
+  uint32_t size() const { return entries; }
+  bool read(uint32_t index, SensorData &out);
+
+  // Index of the first entry at or after t, or size() if there is none.
+  // The block headers double as a sparse time index (one base time per
+  // HISTORY_BLOCK_SAMPLES entries): binary-search them reading 16 bytes per
+  // probe, then scan the one block that can hold t. Assumes time order; a
+  // clock stepped back only makes the bound approximate around the step.
+  uint32_t lowerBound(time_t t);
+
+private:
+  bool readHeader(uint32_t b, HistoryBlockHeader &out);
+  bool inCachedBlock(uint32_t seq) const {
+    return cachedBlock != UINT32_MAX && seq >= block.hdr.firstIndex &&
+           seq < block.hdr.firstIndex + block.hdr.count;
+  }
+  bool loadBlock(uint32_t b);
+  void cacheBlock(uint32_t b);
+  bool locate(uint32_t seq);
+
+  SegmentLog &log;
+  LogCursor cursor;
+  bool opened = false;
+  uint32_t first = 0;     // absolute slot of the oldest logged block
+  uint32_t full = 0;      // logged blocks; the tail, if trusted, is block `full`
+  uint32_t blocks = 0;    // logical: 0 = oldest
+  uint32_t baseIndex = 0; // firstIndex of the oldest block
+  uint32_t entries = 0;
+  uint32_t cachedBlock = UINT32_MAX;
+  HistoryBlock block;
+  HistoryBlock tail;
+  uint32_t sampleTimes[HISTORY_BLOCK_SAMPLES];
+};
+
+// Appends to the packed history. Samples collect in the tail block in RAM;
+// a tail that fills up (or can't take the next delta) is sealed and appended
+// to the log, and close() commits the log before replacing the tail file
+// once, so a batch costs one sequential append plus one small-file rewrite
+// however many samples it carries. open() drops a stale or damaged tail
+// file (see historyLoadTail()) before anything is appended after it.
+class HistoryWriter {
+public:
+  explicit HistoryWriter(SegmentLog &log) : target(log) {}
+  ~HistoryWriter() { close(); }
+
+  bool open();
+  bool append(const SensorData &data);
+  // Full blocks first, so the tail file never gets ahead of the log. False
+  // if the tail file couldn't be replaced.
+  bool close();
+
+  // Blocks rotated out by this writer; their entries left the history
+  uint32_t evictedBlocks() const { return log.evicted(); }
+  // open() dropped a tail block that failed its check
+  bool trimmedTail() const { return trimmed; }
+  // Entries the trimmed tail block claimed to hold
+  uint8_t trimmedEntries() const { return trimmedCount; }
+
+private:
+  void startTail(uint32_t firstIndex);
+  bool sealTail();
+  bool writeTail();
+
+  SegmentLog &target;
+  LogWriter log;
+  HistoryBlock tail;
+  uint32_t samplesCrc = 0; // running CRC of the tail's samples
+  uint32_t lastTime = 0;   // timestamp of the tail's newest sample
+  bool tailDirty = false;
+  bool trimmed = false;
+  uint8_t trimmedCount = 0;
+};
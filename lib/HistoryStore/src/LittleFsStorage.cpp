@@ -0,0 +1,52 @@
+#ifdef ARDUINO
+
+#include "LittleFsStorage.h"
+
+int LittleFsStorage::open(const char *path, Mode mode) {
+  for (int h = 0; h < MAX_OPEN; h++) {
+    if (files[h])
+      continue;
+    files[h] = LittleFS.open(path, mode == READ     ? FILE_READ
+                                   : mode == APPEND ? FILE_APPEND
+                                                    : FILE_WRITE);
+    return files[h] ? h : -1;
+  }
+  return -1;
+}
+
+size_t LittleFsStorage::readAt(int h, uint32_t offset, void *buf,
+                               size_t len) {
+  if (h < 0 || h >= MAX_OPEN || !files[h] || !files[h].seek(offset))
+    return 0;
+  return files[h].read((uint8_t *)buf, len);
+}
+
+size_t LittleFsStorage::write(int h, const void *buf, size_t len) {
+  if (h < 0 || h >= MAX_OPEN || !files[h])
+    return 0;
+  return files[h].write((const uint8_t *)buf, len);
+}
+
+uint32_t LittleFsStorage::size(int h) {
+  return h >= 0 && h < MAX_OPEN && files[h] ? files[h].size() : 0;
+}
+
+void LittleFsStorage::close(int h) {
+  if (h >= 0 && h < MAX_OPEN && files[h])
+    files[h].close();
+}
+
+bool LittleFsStorage::list(const char *dir, ListFn fn, void *ctx) {
+  File d = LittleFS.open(dir);
+  if (!d || !d.isDirectory())
+    return false;
+  for (File f = d.openNextFile(); f; f = d.openNextFile()) {
+    // arduino-esp32 2.x returns the bare name, 1.x the full path
+    const char *name = f.name();
+    const char *slash = strrchr(name, '/');
+    fn(slash ? slash + 1 : name, f.size(), ctx);
+  }
+  return true;
+}
+
+#endif
@@ -0,0 +1,37 @@
+#pragma once
+
+#ifdef ARDUINO
+
+#include "Storage.h"
+
+#include <LittleFS.h>
+
+// Storage on the LittleFS partition. mount() only begins the filesystem
+// without formatting; firmware with its own mount policy overrides it.
+class LittleFsStorage : public Storage {
+public:
+  bool mount() override { return LittleFS.begin(false); }
+  int open(const char *path, Mode mode) override;
+  size_t write(int h, const void *buf, size_t len) override;
+  uint32_t size(int h) override;
+  void close(int h) override;
+  bool exists(const char *path) override { return LittleFS.exists(path); }
+  bool remove(const char *path) override { return LittleFS.remove(path); }
+  bool rename(const char *from, const char *to) override {
+    return LittleFS.rename(from, to);
+  }
+  bool mkdir(const char *path) override { return LittleFS.mkdir(path); }
+  bool rmdir(const char *path) override { return LittleFS.rmdir(path); }
+  bool list(const char *dir, ListFn fn, void *ctx) override;
+
+protected:
+  size_t readAt(int h, uint32_t offset, void *buf, size_t len) override;
+
+private:
+  // Readers of the history view, an export, a flush and its rollup sinks
+  // can all be open at once; LittleFS.begin() allows 10 files
+  static const int MAX_OPEN = 8;
+  File files[MAX_OPEN];
+};
+
+#endif
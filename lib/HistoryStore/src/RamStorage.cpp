@@ -0,0 +1,132 @@
+#include "RamStorage.h"
+
+#include <string.h>
+
+bool RamStorage::parentExists(const std::string &path) const {
+  size_t slash = path.rfind('/');
+  return slash == 0 || dirs.count(path.substr(0, slash)) > 0;
+}
+
+int RamStorage::open(const char *path, Mode mode) {
+  auto it = files.find(path);
+  if (mode == READ && it == files.end())
+    return -1;
+  if (mode != READ && (dirs.count(path) || !parentExists(path)))
+    return -1;
+  for (int h = 0; h < MAX_OPEN; h++) {
+    if (handles[h].used)
+      continue;
+    if (mode == REPLACE || it == files.end())
+      files[path].clear();
+    handles[h].used = true;
+    handles[h].path = path;
+    return h;
+  }
+  return -1;
+}
+
+size_t RamStorage::readAt(int h, uint32_t offset, void *buf, size_t len) {
+  if (h < 0 || h >= MAX_OPEN || !handles[h].used)
+    return 0;
+  const std::vector<uint8_t> &data = files[handles[h].path];
+  if (offset >= data.size())
+    return 0;
+  size_t n = len < data.size() - offset ? len : data.size() - offset;
+  memcpy(buf, data.data() + offset, n);
+  return n;
+}
+
+size_t RamStorage::write(int h, const void *buf, size_t len) {
+  if (h < 0 || h >= MAX_OPEN || !handles[h].used)
+    return 0;
+  if (failAfterBytes >= 0 && written + (long)len > failAfterBytes)
+    len = failAfterBytes > written ? failAfterBytes - written : 0;
+  std::vector<uint8_t> &data = files[handles[h].path];
+  data.insert(data.end(), (const uint8_t *)buf, (const uint8_t *)buf + len);
+  written += len;
+  return len;
+}
+
+uint32_t RamStorage::size(int h) {
+  if (h < 0 || h >= MAX_OPEN || !handles[h].used)
+    return 0;
+  return files[handles[h].path].size();
+}
+
+void RamStorage::close(int h) {
+  if (h >= 0 && h < MAX_OPEN)
+    handles[h].used = false;
+}
+
+bool RamStorage::exists(const char *path) {
+  return files.count(path) > 0 || dirs.count(path) > 0;
+}
+
+bool RamStorage::remove(const char *path) { return files.erase(path) > 0; }
+
+bool RamStorage::mkdir(const char *path) {
+  if (exists(path) || !parentExists(path))
+    return false;
+  dirs.insert(path);
+  return true;
+}
+
+bool RamStorage::rmdir(const char *path) {
+  std::string prefix = std::string(path) + "/";
+  for (const auto &f : files) {
+    if (f.first.compare(0, prefix.size(), prefix) == 0)
+      return false;
+  }
+  return dirs.erase(path) > 0;
+}
+
+bool RamStorage::rename(const char *from, const char *to) {
+  if (exists(to) || !exists(from))
+    return false;
+  auto it = files.find(from);
+  if (it != files.end()) {
+    files[to] = std::move(it->second);
+    files.erase(it);
+    return true;
+  }
+  // Directory: move it and everything below it
+  std::string prefix = std::string(from) + "/";
+  std::map<std::string, std::vector<uint8_t>> moved;
+  for (auto f = files.begin(); f != files.end();) {
+    if (f->first.compare(0, prefix.size(), prefix) == 0) {
+      moved[std::string(to) + f->first.substr(strlen(from))] =
+          std::move(f->second);
+      f = files.erase(f);
+    } else {
+      ++f;
+    }
+  }
+  files.insert(moved.begin(), moved.end());
+  dirs.erase(from);
+  dirs.insert(to);
+  return true;
+}
+
+bool RamStorage::list(const char *dir, ListFn fn, void *ctx) {
+  if (!dirs.count(dir))
+    return false;
+  std::string prefix = std::string(dir) + "/";
+  for (const auto &f : files) {
+    if (f.first.compare(0, prefix.size(), prefix) == 0 &&
+        f.first.find('/', prefix.size()) == std::string::npos)
+      fn(f.first.c_str() + prefix.size(), f.second.size(), ctx);
+  }
+  return true;
+}
+
+std::vector<uint8_t> *RamStorage::file(const char *path) {
+  auto it = files.find(path);
+  return it == files.end() ? nullptr : &it->second;
+}
+
+int RamStorage::openCount() const {
+  int n = 0;
+  for (const Handle &h : handles)
+    n += h.used;
+  return n;
+}
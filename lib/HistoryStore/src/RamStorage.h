@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Storage.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// Storage kept in heap memory, for the native tests. Files and directories
+// behave like LittleFS for everything the logs rely on: a missing parent
+// directory fails an open, rmdir() of a non-empty directory fails, rename()
+// moves a directory with everything in it. failAfterBytes simulates a full
+// partition (or a power cut): writes stop short once that many bytes have
+// been written in total.
+class RamStorage : public Storage {
+public:
+  bool mount() override { return mounted; }
+  int open(const char *path, Mode mode) override;
+  size_t write(int h, const void *buf, size_t len) override;
+  uint32_t size(int h) override;
+  void close(int h) override;
+  bool exists(const char *path) override;
+  bool remove(const char *path) override;
+  bool rename(const char *from, const char *to) override;
+  bool mkdir(const char *path) override;
+  bool rmdir(const char *path) override;
+  bool list(const char *dir, ListFn fn, void *ctx) override;
+
+  // Direct access for tests that damage or inspect files
+  std::vector<uint8_t> *file(const char *path);
+  int openCount() const;
+
+  bool mounted = true;
+  long failAfterBytes = -1; // < 0: never
+
+protected:
+  size_t readAt(int h, uint32_t offset, void *buf, size_t len) override;
+
+private:
+  static const int MAX_OPEN = 8;
+  struct Handle {
+    bool used;
+    std::string path;
+  };
+  bool parentExists(const std::string &path) const;
+
+  std::map<std::string, std::vector<uint8_t>> files;
+  std::set<std::string> dirs;
+  Handle handles[MAX_OPEN] = {};
+  long written = 0;
+};
@@ -0,0 +1,179 @@
+#include "Series.h"
+
+#include <math.h>
+
+// Magnus saturation vapour pressure over water (hPa), Sonntag 1990 constants
+static float saturationHpa(float t) { return 6.112f * expf(17.62f * t / (243.12f + t)); }
+
+float channelValue(const SensorData &d, int channel) {
+  switch (channel) {
+  case SERIES_TEMP:
+    return d.temperature;
+  case SERIES_HUMID:
+    return d.humidity;
+  case SERIES_PRESSURE:
+    return d.pressure;
+  case SERIES_DEWPOINT: {
+    float g = logf(fmaxf(d.humidity, 1.0f) / 100.0f) +
+              17.62f * d.temperature / (243.12f + d.temperature);
+    return 243.12f * g / (17.62f - g);
+  }
+  case SERIES_ABSHUMID: // g/m^3
+    return 216.7f * d.humidity / 100.0f * saturationHpa(d.temperature) /
+           (273.15f + d.temperature);
+  }
+  return 0;
+}
+
+// ---- Rollups ----
+
+static void statsAdd(ChannelStats &st, float v, bool first) {
+  if (first) {
+    st.minVal = st.maxVal = st.mean = v;
+    return;
+  }
+  if (v < st.minVal)
+    st.minVal = v;
+  if (v > st.maxVal)
+    st.maxVal = v;
+  st.mean += v;
+}
+
+bool rollupAdd(RollupRecord &open, int tier, const SensorData &data,
+               RollupRecord &done) {
+  uint32_t period = (uint32_t)data.timestamp -
+                    (uint32_t)data.timestamp % TIER_SECONDS[tier];
+  bool finished = open.count > 0 && open.periodStart != period;
+  if (finished) {
+    done = open;
+    for (int i = 0; i < ENABLED_CHANNEL_COUNT; i++)
+      done.stats[i].mean /= done.count;
+    open.count = 0;
+  }
+  bool first = open.count == 0;
+  if (first)
+    open.periodStart = period;
+  for (int c = 0; c < SERIES_CHANNELS; c++) {
+    if (channelEnabled(c))
+      statsAdd(open.stats[channelSlot(c)], channelValue(data, c), first);
+  }
+  open.count++;
+  return finished;
+}
+
+// ---- Series ----
+
+time_t rangeSeconds(TimeRange range) {
+  switch (range) {
+  case RANGE_WEEKLY:
+    return 604800; // 7d
+  case RANGE_MONTHLY:
+    return 2592000; // 30d
+  case RANGE_YEARLY:
+    return 31536000; // 365d
+  case RANGE_DAILY:
+  default:
+    return 86400; // 24h
+  }
+}
+
+int tierForRange(TimeRange range) {
+  uint32_t column = rangeSeconds(range) / GRAPH_POINTS;
+  for (int t = TIER_COUNT - 1; t >= 0; t--) {
+    if (TIER_SECONDS[t] <= column)
+      return t;
+  }
+  return -1;
+}
+
+// Fold n readings (range lo..hi, summing to sum) at time ts into its column
+static void bucketFold(SeriesBucket *buckets, time_t startTime, time_t span,
+                       time_t ts, float lo, float hi, float sum, uint32_t n,
+                       int &filled) {
+  int b = (int)((int64_t)(ts - startTime) * GRAPH_POINTS / span);
+  if (b >= GRAPH_POINTS)
+    b = GRAPH_POINTS - 1;
+
+  SeriesBucket &bk = buckets[b];
+  if (bk.count == 0) {
+    bk.minVal = lo;
+    bk.maxVal = hi;
+    bk.mean = sum;
+    filled++;
+  } else {
+    if (lo < bk.minVal)
+      bk.minVal = lo;
+    if (hi > bk.maxVal)
+      bk.maxVal = hi;
+    bk.mean += sum; // running sum until the pass is done
+  }
+  bk.count += n;
+}
+
+void seriesBegin(SeriesCacheEntry &e) {
+  for (int c = 0; c < ENABLED_CHANNEL_COUNT; c++) {
+    e.filled[c] = 0;
+    for (int b = 0; b < GRAPH_POINTS; b++) {
+      e.buckets[c][b].count = 0;
+    }
+  }
+}
+
+void seriesEnd(SeriesCacheEntry &e) {
+  for (int c = 0; c < ENABLED_CHANNEL_COUNT; c++) {
+    for (int b = 0; b < GRAPH_POINTS; b++) {
+      SeriesBucket &bk = e.buckets[c][b];
+      if (bk.count > 0)
+        bk.mean /= bk.count;
+    }
+  }
+}
+
+// Fold one raw reading into every enabled channel's column
+void seriesFoldReading(SeriesCacheEntry &e, const SensorData &data) {
+  time_t span = e.endTime - e.startTime;
+  for (int c = 0; c < SERIES_CHANNELS; c++) {
+    if (!channelEnabled(c))
+      continue;
+    int k = channelSlot(c);
+    float v = channelValue(data, c);
+    bucketFold(e.buckets[k], e.startTime, span, data.timestamp, v, v, v, 1,
+               e.filled[k]);
+  }
+}
+
+void seriesFoldRollup(SeriesCacheEntry &e, const RollupRecord &rec,
+                      bool meanIsSum) {
+  time_t span = e.endTime - e.startTime;
+  for (int k = 0; k < ENABLED_CHANNEL_COUNT; k++) {
+    const ChannelStats &st = rec.stats[k];
+    if (isnan(st.mean))
+      continue; // period from before the channel was enabled
+    bucketFold(e.buckets[k], e.startTime, span, rec.periodStart, st.minVal,
+               st.maxVal, meanIsSum ? st.mean : st.mean * rec.count, rec.count,
+               e.filled[k]);
+  }
+}
+
+void seriesFoldRollupLog(SeriesCacheEntry &e, SegmentLog &log) {
+  RecordReader<RollupRecord> reader(log);
+  RollupRecord rec;
+  if (!reader.open())
+    return;
+  uint32_t lo = 0;
+  uint32_t hi = reader.size();
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (!reader.read(mid, rec))
+      break;
+    if ((time_t)rec.periodStart < e.startTime)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  for (uint32_t i = lo; reader.read(i, rec); i++) {
+    if ((time_t)rec.periodStart > e.endTime)
+      break;
+    seriesFoldRollup(e, rec, false);
+  }
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+// Rollup records and graph series: the per-channel aggregates kept
+// alongside the raw history and the bucketing that turns either into graph
+// columns.
+
+#include "HistoryStore.h"
+
+// The channel set comes from the project's config.h (include/, see
+// config.h.template) when there is one, so the firmware and this library
+// always agree on the RollupRecord layout
+#if __has_include("config.h")
+#include "config.h"
+#endif
+
+// Channels kept in the rollups and offered as graphs. Temperature,
+// humidity and pressure are always in the raw history; dew point and
+// absolute humidity are derived from it.
+#define CH_TEMP 0x01
+#define CH_HUMID 0x02
+#define CH_PRESSURE 0x04
+#define CH_DEWPOINT 0x08
+#define CH_ABSHUMID 0x10
+#ifndef SENSOR_CHANNELS
+#define SENSOR_CHANNELS (CH_TEMP | CH_HUMID | CH_PRESSURE)
+#endif
+
+#define ROLLUP_MAGIC 0x4C524D52 // "RMRL"
+#define ROLLUP_VERSION 1
+
+// Time ranges for graphs
+enum TimeRange {
+  RANGE_DAILY,   // 24h
+  RANGE_WEEKLY,  // 7d
+  RANGE_MONTHLY, // 30d
+  RANGE_YEARLY   // 365d
+};
+
+// Precomputed aggregates so long graph ranges read a few hundred rollup
+// records instead of every raw reading
+enum RollupTier {
+  TIER_HOURLY,
+  TIER_DAILY,
+  TIER_COUNT
+};
+const uint32_t TIER_SECONDS[TIER_COUNT] = {3600, 86400};
+
+// Graphable quantities, in CH_* bit order
+enum SeriesChannel {
+  SERIES_TEMP,
+  SERIES_HUMID,
+  SERIES_PRESSURE,
+  SERIES_DEWPOINT,
+  SERIES_ABSHUMID,
+  SERIES_CHANNELS
+};
+
+// Channels in SENSOR_CHANNELS get a slot, in enum order, in the rollup
+// records and the series cache; the rest cost neither flash nor RAM
+constexpr int bitCount(uint32_t m) { return m ? (m & 1) + bitCount(m >> 1) : 0; }
+constexpr uint32_t ENABLED_CHANNELS =
+    SENSOR_CHANNELS & ((1u << SERIES_CHANNELS) - 1);
+constexpr int ENABLED_CHANNEL_COUNT = bitCount(ENABLED_CHANNELS);
+constexpr bool channelEnabled(int c) { return ENABLED_CHANNELS & (1u << c); }
+constexpr int channelSlot(int c) {
+  return bitCount(ENABLED_CHANNELS & ((1u << c) - 1));
+}
+static_assert(ENABLED_CHANNEL_COUNT > 0, "SENSOR_CHANNELS enables nothing");
+
+struct ChannelStats {
+  float minVal;
+  float maxVal;
+  float mean; // NaN: channel wasn't recorded for this period
+};
+
+struct RollupRecord {
+  uint32_t periodStart; // UTC epoch, aligned to the tier period
+  uint32_t count;       // readings folded into this period
+  ChannelStats stats[ENABLED_CHANNEL_COUNT]; // by channelSlot()
+};
+
+// Rollup files from before channel masks carry 0 in the layout word and
+// stats for temperature, humidity and pressure
+#define ROLLUP_LEGACY_CHANNELS (CH_TEMP | CH_HUMID | CH_PRESSURE)
+
+// One graph column: aggregate of every reading whose timestamp falls in the
+// column's time slice (count == 0 means no data there)
+#define GRAPH_POINTS 120
+struct SeriesBucket {
+  float minVal;
+  float maxVal;
+  float mean;
+  uint16_t count;
+};
+
+// One computed graph window, every enabled channel from the same flash pass
+struct SeriesCacheEntry {
+  bool valid;
+  TimeRange range;
+  time_t startTime;
+  time_t endTime;
+  uint32_t lastUsed; // LRU stamp
+  int filled[ENABLED_CHANNEL_COUNT];
+  SeriesBucket buckets[ENABLED_CHANNEL_COUNT][GRAPH_POINTS]; // by channelSlot()
+};
+
+// A channel's value for one reading; derived channels are computed here,
+// so they need no room in the raw history
+float channelValue(const SensorData &d, int channel);
+
+// ---- Rollups ----
+
+// Fold one reading into a tier's open period. When the reading falls into
+// the next period, the finished one is moved to `done` (means divided out)
+// and true returned; the caller persists it.
+bool rollupAdd(RollupRecord &open, int tier, const SensorData &data,
+               RollupRecord &done);
+
+// ---- Series ----
+
+// Span of one graph window for a range
+time_t rangeSeconds(TimeRange range);
+// Coarsest rollup tier whose period still fits inside one graph column, or
+// -1 when the range needs raw readings (24h view)
+int tierForRange(TimeRange range);
+
+// A pass over a window: seriesBegin() empties the buckets, the folds add
+// readings or rollup periods (means kept as running sums), seriesEnd()
+// turns the sums into means
+void seriesBegin(SeriesCacheEntry &e);
+void seriesEnd(SeriesCacheEntry &e);
+void seriesFoldReading(SeriesCacheEntry &e, const SensorData &data);
+// meanIsSum when the period's means are still running sums (an open period)
+void seriesFoldRollup(SeriesCacheEntry &e, const RollupRecord &rec,
+                      bool meanIsSum);
+// Every logged period of a rollup tier inside the window; periods are
+// appended in time order, so the first is found by binary search
+void seriesFoldRollupLog(SeriesCacheEntry &e, SegmentLog &log);
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Every history / rollup read is counted, so the cost of a query can be
+// measured (see test/test_storage_bench)
+struct StorageStats {
+  uint32_t reads;   // read calls
+  uint32_t bytes;   // bytes returned
+  uint32_t records; // samples / rollup records handed to callers
+};
+
+// The file operations the logs need, and nothing more: LittleFsStorage on
+// the device, RamStorage for the native tests. Open files are small integer
+// handles into the implementation's own table, so opening costs no heap
+// allocation and a handle can't outlive its storage.
+class Storage {
+public:
+  enum Mode {
+    READ,    // positional reads
+    APPEND,  // sequential writes at the end, created if missing
+    REPLACE  // truncated (or created) and written from the start
+  };
+  // Called by list() for each entry; name is relative to the directory
+  typedef void (*ListFn)(const char *name, uint32_t size, void *ctx);
+
+  virtual ~Storage() {}
+
+  // Make the partition usable (idempotent); false leaves it untouched
+  virtual bool mount() = 0;
+  // -1 if the file can't be opened (or the table is full)
+  virtual int open(const char *path, Mode mode) = 0;
+  virtual size_t write(int h, const void *buf, size_t len) = 0;
+  virtual uint32_t size(int h) = 0;
+  virtual void close(int h) = 0;
+  virtual bool exists(const char *path) = 0;
+  virtual bool remove(const char *path) = 0;
+  virtual bool rename(const char *from, const char *to) = 0;
+  virtual bool mkdir(const char *path) = 0;
+  virtual bool rmdir(const char *path) = 0;
+  // False if dir isn't a directory
+  virtual bool list(const char *dir, ListFn fn, void *ctx) = 0;
+
+  // Read len bytes at offset; returns the bytes read
+  size_t read(int h, uint32_t offset, void *buf, size_t len) {
+    size_t got = readAt(h, offset, buf, len);
+    stats.reads++;
+    stats.bytes += got;
+    return got;
+  }
+
+  StorageStats stats = {};
+
+protected:
+  virtual size_t readAt(int h, uint32_t offset, void *buf, size_t len) = 0;
+};
@@ -5,9 +5,32 @@
 #define TZ_STRING "UTC0"
 #endif
 
+// Timer samples the deep-sleep wake stub takes between full boots (0 = off)
+#ifndef WAKE_STUB_SAMPLES
+#define WAKE_STUB_SAMPLES 0
+#endif
+
+// BME280 oversampling for logged readings and for the awake live view
+#ifndef SENSOR_LOG_PROFILE
+#define SENSOR_LOG_PROFILE BME_PROFILE_LOW_POWER
+#endif
+#ifndef SENSOR_LIVE_PROFILE
+#define SENSOR_LIVE_PROFILE BME_PROFILE_STANDARD
+#endif
+
+// HTTP endpoint for batched uploads during NTP syncs (empty = off)
+#ifndef UPLOAD_URL
+#define UPLOAD_URL ""
+#endif
+
+#include "driver/gpio.h"
 #include "esp32-hal.h"
+#include "esp_rom_crc.h"
 #include "esp_sleep.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
+#include "freertos/event_groups.h"
+#include "lwip/sockets.h"
 #include "time.h"
 #include <Adafruit_BME280.h>
 #include <Adafruit_GFX.h>
@@ -15,10 +38,30 @@
 #include <Adafruit_Sensor.h>
 #include <Arduino.h>
 #include <ESP32Time.h>
+#include <HTTPClient.h>
+#include <HistoryStore.h>
+#include <LittleFsStorage.h>
 #include <LittleFS.h>
 #include <Preferences.h>
+#include <Series.h>
 #include <WiFi.h>
 #include <Wire.h>
+#include <atomic>
+#if WAKE_STUB_SAMPLES > 0
+#include "esp_idf_version.h"
+// The stub re-sleeps through the esp_wake_stub_* helpers, new in IDF 5.1;
+// Arduino-ESP32 2.x is built on IDF 4.4 (see WAKE_STUB_SAMPLES in
+// config.h.template for the platform to pin)
+#if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 1, 0)
+#error "WAKE_STUB_SAMPLES needs ESP-IDF 5.1 or newer (Arduino-ESP32 3.x)"
+#endif
+#include "esp_rom_sys.h"
+#include "esp_wake_stub.h"
+#include "soc/gpio_reg.h"
+#include "soc/gpio_sig_map.h"
+#include "soc/io_mux_reg.h"
+#include "soc/rtc.h"
+#endif
 
 // Pin Definitions
 #define ENCODER_CLK_PIN GPIO_NUM_4
@@ -33,17 +76,73 @@
 #define SCREEN_HEIGHT 64
 #define OLED_RESET -1
 #define SCREEN_ADDRESS 0x3C
+#define OLED_DATA_CHUNK 64 // GDDRAM bytes per I2C write (Wire buffer is 128)
+#define OLED_TASK_STACK 2048
 
 // Configuration
 #define WIRE_SPEED 400000
+#define BME280_I2C_ADDR 0x76
+#define BME280_MEASURE_US 9300 // max forced conversion time at X1/X1/X1
 #define NTP_STALENESS_INTERVAL                                                 \
   86400 // 1 hour = 3600, 6 hours = 21600, 1 day = 86400,
+// Once two syncs have measured the RTC drift, the next sync is scheduled for
+// when the projected error reaches NTP_MAX_ERROR_S instead
+#define NTP_MAX_ERROR_S 2.0f
+#define NTP_MIN_INTERVAL_S 3600
+#define NTP_MAX_INTERVAL_S (7 * 86400)
+#define NTP_BUDGET_SHARE 0.25f  // max share of daily charge for background syncs
+#define NTP_HARD_ERROR_S 30.0f  // ...unless the projected error is this large
+#define NTP_PORT 123
+#define NTP_REPLY_TIMEOUT_MS 700
+#define NTP_UNIX_OFFSET 2208988800UL // 1900-01-01 to 1970-01-01
+#define WIFI_CACHED_CONNECT_MS 3000 // static IP + pinned BSSID
+#define WIFI_SCAN_CONNECT_MS 15000
+#define WIFI_BLIND_CONNECT_MS 10000
 #define RAM_BUFFER_SIZE 48
+#define FLASH_BATCH_WAKES 4 // background readings staged in RTC per flash append (1 = write every wake)
+#define STAGING_CAPACITY 16 // upper bound on staged readings if flushes keep failing
 #define MAX_FLASH_ENTRIES 8760
-#define ENCODER_DEBOUNCE_MS 5 // Faster debounce, but ISR only on CLK
-#define ENCODER_DETENTS_PER_CLICK                                              \
-  2 // Not used in new ISR; keep for future tuning
+#define HISTORY_DIR "/history" // segmented log, see LogSpec
+#define HISTORY_FILE "/history.dat" // raw SensorData file of earlier firmware
+#define HISTORY_LEGACY_FILE "/history.v1" // raw SensorData log being migrated
+#define HISTORY_CAPACITY_BLOCKS                                                \
+  ((MAX_FLASH_ENTRIES + HISTORY_BLOCK_SAMPLES - 1) / HISTORY_BLOCK_SAMPLES)
+#define ROLLUP_HOURLY_DIR "/rollup_h"
+#define ROLLUP_DAILY_DIR "/rollup_d"
+#define ROLLUP_TMP_DIR "/rollup.tmp" // rollupMigrate() output until renamed
+#define ROLLUP_HOURLY_CAPACITY (24 * 200) // ~6.5 months of hourly periods
+#define ROLLUP_DAILY_CAPACITY (366 * 5)   // 5 years of daily periods
+#define ENCODER_TRANSITIONS_PER_DETENT 4 // quadrature edges per click (2: half-step)
+#define ENCODER_QUEUE_SIZE 32 // detent events buffered while loop() is busy
+// Velocity acceleration for long lists (history entries, graph offsets): a
+// detent arriving within ENCODER_ACCEL_WINDOW_MS of the previous one in the
+// same direction counts 1 + (rate - ENCODER_ACCEL_MIN_RATE)^2 / ENCODER_ACCEL_DIV
+// steps, rate being the smoothed detents per second, capped at ENCODER_ACCEL_MAX
+#define ENCODER_ACCEL_WINDOW_MS 150
+#define ENCODER_ACCEL_MIN_RATE 8
+#define ENCODER_ACCEL_DIV 16
+#define ENCODER_ACCEL_MAX 64
 #define CONFIRM_TIMEOUT_MS 10000 // Auto-cancel destructive prompts after 10 s
+#define CONFIRM_REDRAW_MS 200     // countdown bar refresh
+#define LIVE_UPDATE_MS 5000       // overview sensor refresh while awake
+#define IDLE_LIGHT_SLEEP_MIN_MS 20 // shorter idle waits just block the task
+
+// Adaptive wakeup: the timer interval doubles (up to ADAPTIVE_MAX_STRETCH x
+// the Wakeup setting) while consecutive readings stay inside the deadband,
+// and drops to half the setting when they move more than twice that.
+#define ADAPTIVE_MAX_STRETCH 4        // 1 = fixed interval
+#define ADAPTIVE_TEMP_DEADBAND 0.2f   // C per Wakeup interval
+#define ADAPTIVE_HUMID_DEADBAND 1.0f  // %RH per Wakeup interval
+
+// Power model for the energy estimate (datasheet / bench ballpark figures)
+#define BATTERY_MAH 2000
+#define POWER_CPU_BASE_MA 7.0f     // active current = base + per-MHz * clock
+#define POWER_CPU_MA_PER_MHZ 0.13f // ~12 mA @ 40 MHz, ~17 mA @ 80 MHz
+#define POWER_LIGHT_SLEEP_MA 0.35f
+#define POWER_RADIO_MA 75.0f   // added while WiFi is up (NTP sync)
+#define POWER_DISPLAY_MA 10.0f // SSD1306 on, typical text screen
+#define POWER_DEEP_SLEEP_UA 25.0f // whole board incl. BME280/SSD1306 standby
+#define ASSUMED_USER_WAKES_PER_DAY 6 // until a day of real usage is counted
 
 // Configurable sleep/wakeup options
 const uint32_t SLEEP_OPTIONS_MS[] = {15000, 30000, 60000, 120000, 300000};
@@ -61,6 +160,8 @@ enum SettingsItem {
   SET_SLEEP,
   SET_WAKEUP,
   SET_HISTORY,
+  SET_BOOT_STATS,
+  SET_POWER,
   SET_CLEAR_DATA,
   SETTINGS_COUNT
 };
@@ -97,20 +198,148 @@ enum ConfirmAction {
   CONFIRM_CLEAR_DATA
 };
 
-// Time ranges for graphs
-enum TimeRange {
-  RANGE_DAILY,   // 24h
-  RANGE_WEEKLY,  // 7d
-  RANGE_MONTHLY, // 30d
-  RANGE_YEARLY   // 365d
+// Wake phases timed by PROFILE_SCOPE (inclusive: readAndLogSensor
+// contains the flash flush it triggers)
+enum BootPhase {
+  PH_USB_WAIT,
+  PH_DISPLAY_INIT,
+  PH_NTP,
+  PH_SENSOR_INIT,
+  PH_LOAD_HISTORY,
+  PH_READ_LOG,
+  PH_FLASH_FLUSH,
+  PH_SETUP, // boot to end of setup()
+  PH_AWAKE, // boot to deep sleep
+  PHASE_COUNT
+};
+const char *PHASE_NAMES[PHASE_COUNT] = {"USB",    "Display", "NTP",
+                                        "Sensor", "LoadHist", "ReadLog",
+                                        "Flush",  "Setup",   "Awake"};
+
+enum WakeKind { WAKE_COLD, WAKE_USER, WAKE_TIMER, WAKE_KIND_COUNT };
+const char *WAKE_NAMES[WAKE_KIND_COUNT] = {"cold", "user", "timer"};
+
+// Energy buckets: NTP syncs are booked separately from the wake they ran in
+enum ChargeKind { CHG_TIMER, CHG_USER, CHG_NTP, CHG_KIND_COUNT };
+
+// BME280 oversampling profiles, see BME_PROFILES
+enum BmeProfile {
+  BME_PROFILE_LOW_POWER,
+  BME_PROFILE_STANDARD,
+  BME_PROFILE_PRECISE,
+  BME_PROFILE_COUNT
+};
+
+struct ChargeTotals {
+  uint32_t count; // wakes (or syncs for CHG_NTP)
+  float mAs;      // estimated charge, milliamp-seconds
+};
+
+// Phase durations of one wake (0 = phase didn't run)
+struct BootProfile {
+  uint8_t wake; // WakeKind
+  uint32_t phaseUs[PHASE_COUNT];
+};
+
+const LogSpec HISTORY_LOG = {HISTORY_DIR,          HISTORY_MAGIC,
+                             HISTORY_VERSION,      sizeof(HistoryBlock),
+                             HISTORY_CAPACITY_BLOCKS, 0};
+const LogSpec ROLLUP_LOGS[TIER_COUNT] = {
+    {ROLLUP_HOURLY_DIR, ROLLUP_MAGIC, ROLLUP_VERSION, sizeof(RollupRecord),
+     ROLLUP_HOURLY_CAPACITY, ENABLED_CHANNELS},
+    {ROLLUP_DAILY_DIR, ROLLUP_MAGIC, ROLLUP_VERSION, sizeof(RollupRecord),
+     ROLLUP_DAILY_CAPACITY, ENABLED_CHANNELS},
+};
+
+// Fixed-capacity ring: O(1) push (overwriting the oldest once full) and O(1)
+// indexed access with 0 = oldest. Deliberately an aggregate without
+// constructors: an RTC_DATA_ATTR instance is zeroed once at cold boot and
+// must not be re-initialised by static construction on every wake.
+template <typename T, uint16_t N> struct RingBuffer {
+  T items[N];
+  uint16_t head; // slot the next push() writes
+  uint16_t count;
+
+  void clear() {
+    head = 0;
+    count = 0;
+  }
+  uint16_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  static constexpr uint16_t capacity() { return N; }
+
+  void push(const T &item) {
+    items[head] = item;
+    head = (head + 1) % N;
+    if (count < N)
+      count++;
+  }
+
+  T &operator[](uint16_t i) { return items[(head + N - count + i) % N]; }
+  const T &operator[](uint16_t i) const {
+    return items[(head + N - count + i) % N];
+  }
+  T &back() { return (*this)[count - 1]; }
+
+  // Forget the n oldest items
+  void dropFront(uint16_t n) { count = n < count ? count - n : 0; }
+};
+
+// Lock-free single-producer / single-consumer queue: an ISR push()es, loop()
+// pop()s, and neither ever masks interrupts. Each index is written by one
+// side only; the release store publishes the slot before the index moves.
+// N must be a power of two; one slot stays empty to tell full from empty.
+template <typename T, uint8_t N> class SpscQueue {
+  static_assert((N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+
+public:
+  bool push(const T &item) {
+    uint8_t h = head.load(std::memory_order_relaxed);
+    uint8_t next = (h + 1) & (N - 1);
+    if (next == tail.load(std::memory_order_acquire))
+      return false;
+    items[h] = item;
+    head.store(next, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T &out) {
+    uint8_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire))
+      return false;
+    out = items[t];
+    tail.store((t + 1) & (N - 1), std::memory_order_release);
+    return true;
+  }
+
+  bool empty() const {
+    return tail.load(std::memory_order_acquire) ==
+           head.load(std::memory_order_acquire);
+  }
+
+  // Consumer side only: drop whatever is queued
+  void clear() {
+    tail.store(head.load(std::memory_order_acquire),
+               std::memory_order_release);
+  }
+
+private:
+  T items[N];
+  std::atomic<uint8_t> head{0};
+  std::atomic<uint8_t> tail{0};
 };
 
-// Data structure
-struct SensorData {
-  float temperature;
-  float humidity;
-  float pressure;
-  time_t timestamp;
+#define SERIES_CACHE_SLOTS 4
+
+// BME280 trimming parameters (datasheet 4.2.2), copied from the chip once
+struct Bme280Calib {
+  uint16_t T1;
+  int16_t T2, T3;
+  uint16_t P1;
+  int16_t P2, P3, P4, P5, P6, P7, P8, P9;
+  uint8_t H1, H3;
+  int16_t H2, H4, H5;
+  int8_t H6;
 };
 
 // RTC Memory
@@ -120,9 +349,32 @@ RTC_DATA_ATTR uint32_t flashEntryCount = 0;
 RTC_DATA_ATTR time_t oldestTimestamp = 0;
 RTC_DATA_ATTR time_t newestTimestamp = 0;
 RTC_DATA_ATTR time_t lastNtpSync = 0;
+RTC_DATA_ATTR time_t ntpRefEpoch = 0;     // last NTP-set time, 0 after manual set
+RTC_DATA_ATTR float driftPpm = 0;         // RTC rate error, + = running fast
+RTC_DATA_ATTR bool driftValid = false;
+RTC_DATA_ATTR time_t lastNtpAttempt = 0;
+RTC_DATA_ATTR uint8_t ntpFailStreak = 0;
 RTC_DATA_ATTR int32_t cachedWifiChannel = 0;
 RTC_DATA_ATTR uint8_t cachedWifiBssid[6] = {0};
 RTC_DATA_ATTR bool hasCachedWifi = false;
+// Last DHCP lease, reused as a static config on the cached-BSSID attempt
+RTC_DATA_ATTR uint32_t cachedIp[4] = {0}; // address, gateway, subnet, DNS
+RTC_DATA_ATTR bool hasCachedIp = false;
+RTC_DATA_ATTR uint32_t cachedNtpIp = 0;   // resolved NTP_SERVER
+RTC_DATA_ATTR time_t uploadedUntil = 0;   // newest reading the server acked
+RTC_DATA_ATTR bool storageMarked = false; // "fsMounted" already set this power cycle
+// Open (not yet persisted) rollup period per tier; mean holds a running sum
+RTC_DATA_ATTR RollupRecord rollupOpen[TIER_COUNT];
+RTC_DATA_ATTR bool rollupsValid = false; // false after power loss / clear
+RTC_DATA_ATTR LogState historyLogState;
+RTC_DATA_ATTR LogState rollupLogState[TIER_COUNT];
+// Newest readings (24h at 30min intervals), mirroring the tail of
+// the history log. Kept in RTC memory so it survives deep sleep.
+RTC_DATA_ATTR RingBuffer<SensorData, RAM_BUFFER_SIZE> recentReadings;
+RTC_DATA_ATTR uint32_t recentReadingsCrc = 0; // see recentCacheValid()
+// Background readings not yet appended to the history log (see logReading()).
+// Lost on power loss, so FLASH_BATCH_WAKES bounds what can go missing.
+RTC_DATA_ATTR RingBuffer<SensorData, STAGING_CAPACITY> stagedReadings;
 
 // Global objects
 Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
@@ -134,13 +386,16 @@ Preferences prefs;
 bool displayAvailable = false;
 bool sensorAvailable = false;
 
-// Settings (persisted)
-int sleepTimeoutIdx = 1;   // index into SLEEP_OPTIONS_MS, default 30s
-int wakeupIntervalIdx = 2; // index into WAKEUP_OPTIONS_MIN, default 30min
+// Settings (persisted in Preferences, mirrored in RTC for timer wakes)
+RTC_DATA_ATTR int sleepTimeoutIdx = 1;   // index into SLEEP_OPTIONS_MS, default 30s
+RTC_DATA_ATTR int wakeupIntervalIdx = 2; // index into WAKEUP_OPTIONS_MIN, default 30min
+RTC_DATA_ATTR bool settingsCached = false; // set once loaded from Preferences
 
-// RAM buffer (24h at 30min intervals)
-SensorData ramBuffer[RAM_BUFFER_SIZE];
-int ramBufferCount = 0;
+// Set by initSensor(); lets timer wakes skip the library init entirely
+RTC_DATA_ATTR Bme280Calib bmeCalib;
+RTC_DATA_ATTR bool bmeCalibValid = false;
+
+RTC_DATA_ATTR uint32_t wakeIntervalS = 0; // adaptive timer interval, 0 = unset
 
 // Live update state (while awake)
 SensorData liveData;
@@ -151,13 +406,18 @@ unsigned long lastAnimTick = 0;
 int animX = 0;
 int animDir = 1;
 
-// Encoder state (simplified)
-volatile int encoderTicks = 0; // raw transitions from ISR
-volatile uint8_t lastEncoderState = 0;
+// Encoder state: the ISR decodes quadrature and queues whole detents
+struct EncoderEvent {
+  int8_t steps;   // signed detents (more than one only after a full queue)
+  uint32_t atMs;  // millis() of the last detent
+};
+SpscQueue<EncoderEvent, ENCODER_QUEUE_SIZE> encoderEvents;
+volatile uint8_t lastEncoderState = 0; // (CLK << 1) | DT, ISR-owned
+int8_t encoderTransitions = 0;         // ISR-owned, edges toward the next detent
+int encoderBacklog = 0;                // ISR-owned, detents the full queue refused
 volatile bool buttonPressed = false;
 volatile bool longPress = false;
 volatile unsigned long buttonPressStart = 0;
-volatile unsigned long lastEncoderTime = 0;
 unsigned long lastActivityTime = 0;
 
 // Mode button (separate from encoder click): cycles top mode + force sleep
@@ -167,7 +427,9 @@ volatile unsigned long modeButtonPressStart = 0;
 
 // Filtered encoder state (in detent steps)
 int encoderPos = 0; // logical position in steps
-int lastProcessedTicks = 0;
+uint32_t lastDetentMs = 0;
+int8_t lastDetentDir = 0;
+uint16_t encoderRate = 0; // smoothed detents per second, see encoderAccelerate()
 
 // UI state
 DisplayMode currentMode = MODE_OVERVIEW;
@@ -175,7 +437,7 @@ OverviewPage currentOverviewPage = OV_DEFAULT;
 TimeRange currentRange = RANGE_DAILY;
 int timeOffset = 0;
 int historyIndex = 0;
-bool graphShowTemp = true;
+SeriesChannel graphChannel = SERIES_TEMP;
 int settingsIndex = 0;
 int settingsScroll = 0;
 
@@ -197,38 +459,92 @@ int prevMinute = -1;
 unsigned long minuteSlideStart = 0;
 bool minuteSliding = false;
 
+// Graph windows already computed this session (see getSeries())
+SeriesCacheEntry seriesCache[SERIES_CACHE_SLOTS];
+uint32_t seriesCacheClock = 0;
+
+// Per-wake timings, committed to RTC just before deep sleep
+#define PROFILE_HISTORY 16
+RTC_DATA_ATTR RingBuffer<BootProfile, PROFILE_HISTORY> bootProfiles;
+BootProfile bootProfile; // this wake, filled by PhaseTimer
+
+// Estimated charge per ChargeKind since power-on (see chargeCommit())
+RTC_DATA_ATTR ChargeTotals chargeTotals[CHG_KIND_COUNT];
+RTC_DATA_ATTR float userTimeoutSeconds = 0; // sum of idle tails of user wakes
+RTC_DATA_ATTR time_t chargeSince = 0;       // epoch of the first commit
+// This wake: charge so far per bucket and what currently draws power
+float wakeCharge[CHG_KIND_COUNT];
+ChargeKind wakeChargeKind = CHG_USER;
+ChargeKind chargeBucket = CHG_USER;
+int64_t chargeMarkUs = 0;
+uint8_t wakeNtpRuns = 0;
+bool powerRadioOn = false;
+bool powerDisplayOn = false;
+bool powerLightSleep = false;
+
+// Boot stats sub-view (nested under Settings -> Boot Stats)
+bool inBootStatsView = false;
+int bootStatsScroll = 0;
+bool inPowerView = false; // Settings -> Power Budget
+
+// Notified by the input ISRs so an idle loop() wakes at once
+TaskHandle_t loopTaskHandle = nullptr;
+
 // Suppress non-critical serial output during background wakeups to reduce overhead
 #define LOG(fmt, ...) do { if (!backgroundReading) Serial.printf(fmt, ##__VA_ARGS__); } while(0)
 
 // ========== ISRs ==========
 
-void IRAM_ATTR encoderISR() {
-  unsigned long now = millis();
+static inline void IRAM_ATTR notifyLoop() {
+  if (!loopTaskHandle || !xPortInIsrContext())
+    return; // replayed from task context after light sleep
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(loopTaskHandle, &woken);
+  portYIELD_FROM_ISR(woken);
+}
 
-  // Simple debounce on the encoder
-  if (now - lastEncoderTime < ENCODER_DEBOUNCE_MS)
+// Quadrature step per (previous state << 2 | state), state = (CLK << 1) | DT.
+// A bounce on one contact reads as a step forward and back and cancels out;
+// a transition that changes both bits was missed in between and counts 0.
+static const int8_t QUADRATURE_STEP[16] = {0, -1, 1,  0, 1, 0, 0,  -1,
+                                           -1, 0, 0, 1, 0, 1, -1, 0};
+
+// Fires on every edge of CLK and DT. Edges accumulate into detents, queued
+// with their time so loop() can derive the rotation speed however late it
+// gets to them. Both contacts open (state 0b11) is the detent rest position:
+// there a remainder of at least half a detent rounds to one and the rest is
+// dropped, which realigns the count after a missed edge.
+void IRAM_ATTR encoderISR() {
+  uint8_t state =
+      (digitalRead(ENCODER_CLK_PIN) << 1) | digitalRead(ENCODER_DT_PIN);
+  uint8_t prev = lastEncoderState;
+  if (state == prev)
     return;
-
-  uint8_t clk = digitalRead(ENCODER_CLK_PIN);
-  uint8_t dt = digitalRead(ENCODER_DT_PIN);
-  uint8_t state = (clk << 1) | dt;
-
-  // Only act on a CLK falling edge for stability:
-  // previous CLK bit = 1, current clk = 0
-  if ((lastEncoderState & 0b10) && !clk) {
-    if (dt) {
-      // dt = 1 on clk falling => one direction
-      encoderTicks++;
-    } else {
-      // dt = 0 on clk falling => other direction
-      encoderTicks--;
-    }
-
-    lastEncoderTime = now;
-    lastActivityTime = now;
+  lastEncoderState = state;
+  encoderTransitions += QUADRATURE_STEP[(prev << 2) | state];
+
+  int8_t detent = 0;
+  if (encoderTransitions >= ENCODER_TRANSITIONS_PER_DETENT ||
+      (state == 0b11 &&
+       encoderTransitions >= ENCODER_TRANSITIONS_PER_DETENT / 2)) {
+    detent = 1;
+  } else if (encoderTransitions <= -ENCODER_TRANSITIONS_PER_DETENT ||
+             (state == 0b11 &&
+              encoderTransitions <= -ENCODER_TRANSITIONS_PER_DETENT / 2)) {
+    detent = -1;
   }
+  if (detent != 0 || state == 0b11)
+    encoderTransitions = 0;
+  if (detent == 0)
+    return;
 
-  lastEncoderState = state;
+  unsigned long now = millis();
+  int steps = encoderBacklog + detent;
+  EncoderEvent ev = {(int8_t)constrain(steps, INT8_MIN, INT8_MAX),
+                     (uint32_t)now};
+  encoderBacklog = encoderEvents.push(ev) ? 0 : steps;
+  lastActivityTime = now;
+  notifyLoop();
 }
 
 void IRAM_ATTR buttonISR() {
@@ -245,6 +561,7 @@ void IRAM_ATTR buttonISR() {
     }
   }
   lastActivityTime = now;
+  notifyLoop();
 }
 
 void IRAM_ATTR modeButtonISR() {
@@ -261,11 +578,215 @@ void IRAM_ATTR modeButtonISR() {
     }
   }
   lastActivityTime = now;
+  notifyLoop();
+}
+
+// ========== Profiling ==========
+
+// Adds the lifetime of the scope to bootProfile.phaseUs[phase]
+class PhaseTimer {
+public:
+  explicit PhaseTimer(BootPhase phase)
+      : phase(phase), start(esp_timer_get_time()) {}
+  ~PhaseTimer() {
+    bootProfile.phaseUs[phase] += (uint32_t)(esp_timer_get_time() - start);
+  }
+
+private:
+  BootPhase phase;
+  int64_t start;
+};
+
+#define PROFILE_SCOPE(phase) PhaseTimer phaseTimer(phase)
+
+// ---- Energy estimate ----
+// Charge is integrated piecewise: chargeAccount() books the time since the
+// last mark at the current draw, so it runs right before anything that
+// changes the draw (CPU clock, radio, display, light sleep).
+
+static float chargeCurrentMa() {
+  float ma = powerLightSleep ? POWER_LIGHT_SLEEP_MA
+                             : POWER_CPU_BASE_MA +
+                                   POWER_CPU_MA_PER_MHZ * getCpuFrequencyMhz();
+  if (powerRadioOn)
+    ma += POWER_RADIO_MA;
+  if (powerDisplayOn)
+    ma += POWER_DISPLAY_MA;
+  return ma;
+}
+
+void chargeAccount() {
+  int64_t now = esp_timer_get_time();
+  wakeCharge[chargeBucket] += chargeCurrentMa() * (now - chargeMarkUs) / 1e6f;
+  chargeMarkUs = now;
+}
+
+void setCpuClock(uint32_t mhz) {
+  chargeAccount();
+  setCpuFrequencyMhz(mhz);
+}
+
+void setDisplayPower(bool on) {
+  chargeAccount();
+  powerDisplayOn = on;
+}
+
+// Radio draw for the lifetime of the scope, booked to CHG_NTP
+class RadioChargeScope {
+public:
+  // newRun false: continuing on a link an earlier scope brought up
+  explicit RadioChargeScope(bool newRun = true) : prev(chargeBucket) {
+    chargeAccount();
+    chargeBucket = CHG_NTP;
+    powerRadioOn = true;
+    if (newRun)
+      wakeNtpRuns++;
+  }
+  ~RadioChargeScope() {
+    chargeAccount();
+    powerRadioOn = false;
+    chargeBucket = prev;
+  }
+
+private:
+  ChargeKind prev;
+};
+
+static void chargeCommit() {
+  chargeAccount();
+  for (int k = 0; k < CHG_KIND_COUNT; k++) {
+    chargeTotals[k].mAs += wakeCharge[k];
+  }
+  chargeTotals[wakeChargeKind].count++;
+  chargeTotals[CHG_NTP].count += wakeNtpRuns;
+  if (wakeChargeKind == CHG_USER)
+    userTimeoutSeconds += SLEEP_OPTIONS_MS[sleepTimeoutIdx] / 1000.0f;
+  if (chargeSince == 0)
+    chargeSince = rtc.getEpoch();
+}
+
+struct PowerBudget {
+  float timerMas; // per wake
+  float userMas;  // per session, at the current sleep timeout
+  float ntpMas;   // per sync
+  float userPerDay;
+  float mAhPerDay;
+  float days;
+};
+
+static float avgMas(int kind, float fallback) {
+  const ChargeTotals &t = chargeTotals[kind];
+  return t.count > 0 ? t.mAs / t.count : fallback;
+}
+
+uint32_t ntpIntervalS(); // Time & Settings Helpers
+
+// Project daily charge for the current wakeup interval and sleep timeout.
+// A user session ends with the idle timeout at display-on draw, so that
+// tail is swapped from the timeouts actually used to the current one.
+PowerBudget powerBudget() {
+  PowerBudget b;
+  const float idleMa = POWER_DISPLAY_MA + POWER_LIGHT_SLEEP_MA;
+  const ChargeTotals &user = chargeTotals[CHG_USER];
+  b.timerMas = avgMas(CHG_TIMER, 0);
+  b.ntpMas = avgMas(CHG_NTP, 0);
+  float activeMas = 0;
+  if (user.count > 0)
+    activeMas = max(0.0f, (user.mAs - userTimeoutSeconds * idleMa) / user.count);
+  b.userMas = activeMas + SLEEP_OPTIONS_MS[sleepTimeoutIdx] / 1000.0f * idleMa;
+
+  time_t observed = chargeSince ? rtc.getEpoch() - chargeSince : 0;
+  b.userPerDay = observed >= 86400 ? user.count * 86400.0f / observed
+                                   : ASSUMED_USER_WAKES_PER_DAY;
+  uint32_t intervalS =
+      wakeIntervalS ? wakeIntervalS : WAKEUP_OPTIONS_MIN[wakeupIntervalIdx] * 60;
+  float timerPerDay = 86400.0f / intervalS; // adaptive interval as of now
+#if WAKE_STUB_SAMPLES > 0
+  timerPerDay /= WAKE_STUB_SAMPLES + 1; // stub wakes are below model resolution
+#endif
+  float ntpPerDay = 86400.0f / ntpIntervalS();
+  float masPerDay = b.timerMas * timerPerDay + b.userMas * b.userPerDay +
+                    b.ntpMas * ntpPerDay + POWER_DEEP_SLEEP_UA / 1000.0f * 86400;
+  b.mAhPerDay = masPerDay / 3600.0f;
+  b.days = b.mAhPerDay > 0 ? BATTERY_MAH / b.mAhPerDay : 0;
+  return b;
+}
+
+void printPowerBudget() {
+  PowerBudget b = powerBudget();
+  Serial.println("=== Power budget (estimated) ===");
+  static const char *KIND_NAMES[CHG_KIND_COUNT] = {"timer", "user", "ntp"};
+  for (int k = 0; k < CHG_KIND_COUNT; k++) {
+    Serial.printf("%-6s %5lu x %8.2f mAs avg\n", KIND_NAMES[k],
+                  (unsigned long)chargeTotals[k].count, avgMas(k, 0));
+  }
+  Serial.printf("Wakeup %s, sleep %s, %.1f user wakes/day\n",
+                WAKEUP_LABELS[wakeupIntervalIdx], SLEEP_LABELS[sleepTimeoutIdx],
+                b.userPerDay);
+  Serial.printf("%.2f mAh/day -> ~%.0f days on %d mAh\n", b.mAhPerDay, b.days,
+                BATTERY_MAH);
+}
+
+void profileCommit() {
+  bootProfile.phaseUs[PH_AWAKE] = (uint32_t)esp_timer_get_time();
+  bootProfiles.push(bootProfile);
+  chargeCommit();
+}
+
+struct PhaseStats {
+  uint32_t minUs;
+  uint32_t maxUs;
+  uint64_t sumUs;
+  uint16_t runs;
+};
+
+// min/avg/max of one phase over the stored wakes of the given kind (or all
+// kinds for WAKE_KIND_COUNT); wakes where the phase didn't run are skipped
+static PhaseStats phaseStats(int phase, int wake) {
+  PhaseStats st = {UINT32_MAX, 0, 0, 0};
+  for (uint16_t i = 0; i < bootProfiles.size(); i++) {
+    const BootProfile &bp = bootProfiles[i];
+    uint32_t us = bp.phaseUs[phase];
+    if (us == 0 || (wake != WAKE_KIND_COUNT && bp.wake != wake))
+      continue;
+    st.minUs = min(st.minUs, us);
+    st.maxUs = max(st.maxUs, us);
+    st.sumUs += us;
+    st.runs++;
+  }
+  return st;
+}
+
+void printBootStats() {
+  Serial.printf("=== Boot stats (last %d wakes, ms) ===\n", bootProfiles.size());
+  for (int w = 0; w < WAKE_KIND_COUNT; w++) {
+    bool header = false;
+    for (int p = 0; p < PHASE_COUNT; p++) {
+      PhaseStats st = phaseStats(p, w);
+      if (st.runs == 0)
+        continue;
+      if (!header) {
+        Serial.printf("[%s]      min     avg     max   n\n", WAKE_NAMES[w]);
+        header = true;
+      }
+      Serial.printf("%-8s %7.1f %7.1f %7.1f %3d\n", PHASE_NAMES[p],
+                    st.minUs / 1000.0f, st.sumUs / 1000.0f / st.runs,
+                    st.maxUs / 1000.0f, st.runs);
+    }
+  }
 }
 
 // ========== Hardware Initialization ==========
 
 void setupWakeupSources() {
+  // The fast background path never runs setupEncoder(), so the pull-ups the
+  // low-level wake depends on are (re)applied here
+  const gpio_num_t pins[] = {ENCODER_SW_PIN, ENCODER_CLK_PIN, ENCODER_DT_PIN,
+                             MODE_BUTTON_PIN};
+  for (gpio_num_t pin : pins) {
+    gpio_pullup_en(pin);
+    gpio_pulldown_dis(pin);
+  }
   esp_deep_sleep_enable_gpio_wakeup((1ULL << ENCODER_SW_PIN) |
                                         (1ULL << ENCODER_CLK_PIN) |
                                         (1ULL << ENCODER_DT_PIN) |
@@ -282,12 +803,14 @@ void setupEncoder() {
   // Initial state
   lastEncoderState =
       (digitalRead(ENCODER_CLK_PIN) << 1) | digitalRead(ENCODER_DT_PIN);
-  encoderTicks = 0;
+  encoderTransitions = 0;
+  encoderBacklog = 0;
+  encoderEvents.clear();
   encoderPos = 0;
-  lastProcessedTicks = 0;
 
-  // Only use CLK pin interrupt for rotation, FALLING edge
-  attachInterrupt(digitalPinToInterrupt(ENCODER_CLK_PIN), encoderISR, FALLING);
+  // Both quadrature phases interrupt on every edge; see encoderISR()
+  attachInterrupt(digitalPinToInterrupt(ENCODER_CLK_PIN), encoderISR, CHANGE);
+  attachInterrupt(digitalPinToInterrupt(ENCODER_DT_PIN), encoderISR, CHANGE);
   attachInterrupt(digitalPinToInterrupt(ENCODER_SW_PIN), buttonISR, CHANGE);
   attachInterrupt(digitalPinToInterrupt(MODE_BUTTON_PIN), modeButtonISR,
                   CHANGE);
@@ -300,6 +823,9 @@ void loadSettings() {
   lastNtpSync = prefs.getULong("lastNtpSync", 0);
   sleepTimeoutIdx = prefs.getInt("sleepIdx", 1);
   wakeupIntervalIdx = prefs.getInt("wakeupIdx", 2);
+  driftValid = prefs.isKey("driftPpm");
+  driftPpm = prefs.getFloat("driftPpm", 0);
+  uploadedUntil = prefs.getULong("uploadedTs", 0);
   prefs.end();
 
   // Clamp indices to valid range
@@ -307,6 +833,7 @@ void loadSettings() {
     sleepTimeoutIdx = 1;
   if (wakeupIntervalIdx < 0 || wakeupIntervalIdx >= WAKEUP_OPTIONS_COUNT)
     wakeupIntervalIdx = 2;
+  settingsCached = true;
 
   LOG("Settings loaded: TZ=%s, Sleep=%s, Wakeup=%s\n", TZ_STRING,
       SLEEP_LABELS[sleepTimeoutIdx], WAKEUP_LABELS[wakeupIntervalIdx]);
@@ -317,12 +844,142 @@ void saveSettings() {
   prefs.putULong("lastNtpSync", lastNtpSync);
   prefs.putInt("sleepIdx", sleepTimeoutIdx);
   prefs.putInt("wakeupIdx", wakeupIntervalIdx);
+  if (driftValid)
+    prefs.putFloat("driftPpm", driftPpm);
+  prefs.putULong("uploadedTs", uploadedUntil);
   prefs.end();
   LOG("Settings saved: Sleep=%s, Wakeup=%s\n",
     SLEEP_LABELS[sleepTimeoutIdx], WAKEUP_LABELS[wakeupIntervalIdx]);
 }
 
+#define OLED_FRAME_BYTES (SCREEN_WIDTH * SCREEN_HEIGHT / 8)
+
+// Last frame sent to the panel, so only changed bytes go out again.
+// Not kept across deep sleep: the first flush after boot sends everything.
+static uint8_t oledShadow[OLED_FRAME_BYTES];
+static bool oledShadowValid = false;
+
+// Bus mutex for the flush task and loop(). Wire only locks per
+// transaction, which is not enough: a BME280 register read is a write plus
+// a repeated-start read, and an OLED page is an address window followed by
+// data chunks that must land in that window. Created with the flush task;
+// until then loop() is the only bus user and the guard is a no-op.
+static SemaphoreHandle_t i2cLock = nullptr;
+
+struct I2cBusGuard {
+  I2cBusGuard() {
+    if (i2cLock)
+      xSemaphoreTake(i2cLock, portMAX_DELAY);
+  }
+  ~I2cBusGuard() {
+    if (i2cLock)
+      xSemaphoreGive(i2cLock);
+  }
+};
+
+// Send one frame, for each 8-row page only the column span that differs
+// from the shadow. Most redraws touch a few digits or a single pixel, so
+// this replaces the 1 KB display() burst with a handful of short writes.
+static void oledSend(const uint8_t *frame) {
+  for (uint8_t page = 0; page < SCREEN_HEIGHT / 8; page++) {
+    const uint8_t *row = frame + page * SCREEN_WIDTH;
+    uint8_t *shadow = oledShadow + page * SCREEN_WIDTH;
+    int first = 0;
+    int last = SCREEN_WIDTH - 1;
+    if (oledShadowValid) {
+      while (first < SCREEN_WIDTH && row[first] == shadow[first])
+        first++;
+      if (first == SCREEN_WIDTH)
+        continue; // page unchanged
+      while (row[last] == shadow[last])
+        last--;
+    }
+
+    // Address window = this page, changed columns (horizontal mode)
+    I2cBusGuard bus;
+    Wire.beginTransmission(SCREEN_ADDRESS);
+    Wire.write((uint8_t)0x00); // command stream
+    Wire.write((uint8_t)SSD1306_PAGEADDR);
+    Wire.write(page);
+    Wire.write(page);
+    Wire.write((uint8_t)SSD1306_COLUMNADDR);
+    Wire.write((uint8_t)first);
+    Wire.write((uint8_t)last);
+    Wire.endTransmission();
+
+    for (int x = first; x <= last; x += OLED_DATA_CHUNK) {
+      int n = min(OLED_DATA_CHUNK, last - x + 1);
+      Wire.beginTransmission(SCREEN_ADDRESS);
+      Wire.write((uint8_t)0x40); // data stream
+      Wire.write(row + x, n);
+      Wire.endTransmission();
+    }
+    memcpy(shadow + first, row + first, last - first + 1);
+  }
+  oledShadowValid = true;
+}
+
+// Asynchronous flush: oledFlush() snapshots the framebuffer into
+// oledPending and wakes oledFlushTask, which sends it while loop() keeps
+// rendering and polling the encoder. A frame queued while another is in
+// flight replaces the pending one, so a slow bus drops stale frames rather
+// than falling behind. Sensor reads from loop() take i2cLock, so they slot
+// in between pages rather than inside one.
+static uint8_t oledPending[OLED_FRAME_BYTES];
+static SemaphoreHandle_t oledPendingLock = nullptr;
+static TaskHandle_t oledTask = nullptr;
+static volatile uint32_t oledQueued = 0; // frames handed to the task
+static volatile uint32_t oledSent = 0;   // frames the task has finished
+
+static void oledFlushTask(void *) {
+  static uint8_t sending[OLED_FRAME_BYTES];
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    xSemaphoreTake(oledPendingLock, portMAX_DELAY);
+    memcpy(sending, oledPending, OLED_FRAME_BYTES);
+    uint32_t seq = oledQueued;
+    xSemaphoreGive(oledPendingLock);
+    oledSend(sending);
+    oledSent = seq;
+  }
+}
+
+// Block until the last queued frame is on the panel. Needed before other
+// traffic that must follow it (display off, Wire.end() before sleep).
+void oledWaitIdle() {
+  while (oledTask && oledSent != oledQueued)
+    vTaskDelay(1);
+}
+
+void oledFlush() {
+  if (!displayAvailable)
+    return;
+  if (!oledTask) {
+    oledSend(display.getBuffer()); // no task (yet): send inline
+    return;
+  }
+  xSemaphoreTake(oledPendingLock, portMAX_DELAY);
+  memcpy(oledPending, display.getBuffer(), OLED_FRAME_BYTES);
+  oledQueued++;
+  xSemaphoreGive(oledPendingLock);
+  xTaskNotifyGive(oledTask);
+}
+
+static void startOledFlushTask() {
+  oledPendingLock = xSemaphoreCreateMutex();
+  i2cLock = xSemaphoreCreateMutex();
+  // Above loop() so a queued frame starts at once; it blocks on the I2C
+  // driver during the transfer, handing the CPU back to loop()
+  if (!oledPendingLock || !i2cLock ||
+      xTaskCreate(oledFlushTask, "oledFlush", OLED_TASK_STACK, nullptr, 2,
+                  &oledTask) != pdPASS) {
+    oledTask = nullptr;
+    Serial.println("OLED flush task unavailable, flushing inline");
+  }
+}
+
 void initDisplay() {
+  PROFILE_SCOPE(PH_DISPLAY_INIT);
   Serial.println("Initializing display...");
   if (!display.begin(SSD1306_SWITCHCAPVCC, SCREEN_ADDRESS)) {
     Serial.println("SSD1306 not found");
@@ -330,16 +987,18 @@ void initDisplay() {
     return;
   }
   displayAvailable = true;
+  setDisplayPower(true);
   Serial.println("Display OK");
   display.clearDisplay();
   display.setTextSize(1);
   display.setTextColor(SSD1306_WHITE);
-  display.display();
+  oledFlush();
+  startOledFlushTask();
 }
 
 void printWiFiStatus() {
   Serial.println("\n=== WiFi Debug ===");
-  Serial.printf("SSID Length: %d\n", strlen(WIFI_SSID));
+  Serial.printf("SSID Length: %u\n", (unsigned)strlen(WIFI_SSID));
   Serial.printf("SSID: %s\n", WIFI_SSID);
   Serial.printf("WiFi Status: %d\n", WiFi.status());
   Serial.printf("WiFi Mode: %d\n", WiFi.getMode());
@@ -424,25 +1083,123 @@ static const char *wifiDisconnectReason(uint8_t reason) {
   }
 }
 
-bool syncTimeWithNTP() {
-  // ---- 1. Bring the radio up cleanly ----
-  // Order matters on ESP32-C3: driver must be STARTED before esp_wifi_set_*.
-  // WiFi.disconnect(true, ...) turns the radio OFF, which makes subsequent
-  // esp_wifi_* calls silently fail.
-  WiFi.persistent(false);
-  WiFi.mode(WIFI_OFF);
-  delay(50);
-  WiFi.mode(WIFI_STA); // starts the driver
-  delay(100);
+// ---- Event-driven WiFi waits ----
+#define WIFI_EVT_UP BIT0   // got IP (DHCP or static)
+#define WIFI_EVT_DOWN BIT1 // disconnected / connect attempt failed
+static EventGroupHandle_t wifiEvents = nullptr;
 
+static void wifiEventsInit() {
+  if (wifiEvents)
+    return;
+  wifiEvents = xEventGroupCreate();
+  WiFi.onEvent(
+      [](WiFiEvent_t event, WiFiEventInfo_t info) {
+        xEventGroupSetBits(wifiEvents, WIFI_EVT_UP);
+      },
+      ARDUINO_EVENT_WIFI_STA_GOT_IP);
   // Log disconnect reasons (helps diagnose auth/assoc failures)
   WiFi.onEvent(
       [](WiFiEvent_t event, WiFiEventInfo_t info) {
         uint8_t reason = info.wifi_sta_disconnected.reason;
         Serial.printf("[WiFi] Disconnect reason %u: %s\n", reason,
                       wifiDisconnectReason(reason));
+        xEventGroupSetBits(wifiEvents, WIFI_EVT_DOWN);
       },
       ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+}
+
+static void wifiBegin(const char *ssid, const char *pass, int ch = 0,
+                      const uint8_t *bssid = nullptr) {
+  xEventGroupClearBits(wifiEvents, WIFI_EVT_UP | WIFI_EVT_DOWN);
+  WiFi.begin(ssid, pass, ch, bssid);
+}
+
+// Block until an IP is up; failFast also gives up on the first disconnect
+// (the cached attempt: a wrong BSSID/lease should fall through quickly)
+static bool wifiWaitUp(uint32_t timeoutMs, bool failFast) {
+  EventBits_t bits = xEventGroupWaitBits(
+      wifiEvents, WIFI_EVT_UP | (failFast ? WIFI_EVT_DOWN : 0), pdFALSE,
+      pdFALSE, pdMS_TO_TICKS(timeoutMs));
+  return (bits & WIFI_EVT_UP) && WiFi.status() == WL_CONNECTED;
+}
+
+// ---- SNTP ----
+static uint32_t be32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static int64_t ntpToUs(const uint8_t *p) {
+  return (int64_t)be32(p) * 1000000 + (((uint64_t)be32(p + 4) * 1000000) >> 32);
+}
+
+// One SNTP (RFC 4330) client exchange on a blocking socket with a receive
+// timeout. On success unixUs is the server time at esp_timer atUs: transmit
+// time plus half the round trip net of the server's hold time.
+static bool sntpQuery(uint32_t serverIp, int64_t &unixUs, int64_t &atUs) {
+  int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (sock < 0)
+    return false;
+  struct timeval timeout = {0, NTP_REPLY_TIMEOUT_MS * 1000};
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(NTP_PORT);
+  addr.sin_addr.s_addr = serverIp;
+
+  uint8_t pkt[48] = {0x23}; // LI 0, version 4, mode 3 (client)
+  uint32_t nonce = (uint32_t)esp_timer_get_time() ^ 0x5EED1E55;
+  memcpy(pkt + 44, &nonce, 4); // echoed back as the originate fraction
+  int64_t sentUs = esp_timer_get_time();
+  bool ok = sendto(sock, pkt, sizeof(pkt), 0, (struct sockaddr *)&addr,
+                   sizeof(addr)) == sizeof(pkt) &&
+            recv(sock, pkt, sizeof(pkt), 0) == sizeof(pkt);
+  atUs = esp_timer_get_time();
+  close(sock);
+  if (!ok)
+    return false;
+
+  uint8_t li = pkt[0] >> 6, mode = pkt[0] & 7, stratum = pkt[1];
+  if (li == 3 || mode != 4 || stratum == 0 || stratum > 15 ||
+      memcmp(pkt + 28, &nonce, 4) != 0)
+    return false; // unsynchronised server, kiss-o'-death or stray reply
+  int64_t rxUs = ntpToUs(pkt + 32), txUs = ntpToUs(pkt + 40);
+  int64_t rttUs = (atUs - sentUs) - (txUs - rxUs);
+  unixUs = txUs - NTP_UNIX_OFFSET * 1000000LL + rttUs / 2;
+  return true;
+}
+
+void uploadPendingReadings(); // Batch Upload
+bool uploadDeferred = false;  // syncTimeWithNTP(true) left the link up
+
+// Fold one sync's clock correction into the drift estimate. rtcNow is the
+// pre-sync clock; spans under NTP_MIN_INTERVAL_S are too short to resolve.
+static void recordNtpOffset(time_t rtcNow, double offsetS) {
+  time_t span = ntpRefEpoch ? rtcNow - ntpRefEpoch : 0;
+  Serial.printf("NTP: RTC off by %+.3f s", offsetS);
+  if (span >= NTP_MIN_INTERVAL_S) {
+    float ppm = (float)(-offsetS / span * 1e6);
+    driftPpm = driftValid ? (driftPpm + ppm) / 2 : ppm; // light smoothing
+    driftValid = true;
+    Serial.printf(" over %lds (%+.1f ppm, est. %+.1f ppm)", (long)span, ppm,
+                  driftPpm);
+  }
+  Serial.println();
+}
+
+// deferUpload: the caller hasn't loaded the history yet (setup()), so keep
+// the link up and leave the upload to uploadAndDisconnect()
+bool syncTimeWithNTP(bool deferUpload = false) {
+  PROFILE_SCOPE(PH_NTP);
+  RadioChargeScope radioCharge;
+  lastNtpAttempt = rtc.getEpoch();
+  // ---- 1. Bring the radio up cleanly ----
+  // Order matters on ESP32-C3: driver must be STARTED before esp_wifi_set_*.
+  // WiFi.disconnect(true, ...) turns the radio OFF, which makes subsequent
+  // esp_wifi_* calls silently fail.
+  WiFi.persistent(false);
+  WiFi.mode(WIFI_OFF);
+  WiFi.mode(WIFI_STA); // starts the driver; returns once it is up
+  wifiEventsInit();
 
   // ---- 2. Apply C3-friendly settings (now that driver is up) ----
   // - Set EU country code so ch 12-13 are also scanned (default may be ch1-11).
@@ -478,23 +1235,28 @@ bool syncTimeWithNTP() {
 
   // ---- 4. Connect: cached BSSID → scan+BSSID → blind retry ----
   bool wifiConnected = false;
+  bool staticIp = false;
 
-  // Attempt A: use cached channel+BSSID if available — skips the full scan
+  // Attempt A: cached channel+BSSID (skips the scan) and, when we have one,
+  // the last lease as a static config (skips DHCP)
   if (hasCachedWifi) {
     Serial.printf("Trying cached ch%ld %02X:%02X:%02X:%02X:%02X:%02X\n",
-                  cachedWifiChannel,
+                  (long)cachedWifiChannel,
                   cachedWifiBssid[0], cachedWifiBssid[1], cachedWifiBssid[2],
                   cachedWifiBssid[3], cachedWifiBssid[4], cachedWifiBssid[5]);
-    WiFi.begin(WIFI_SSID, WIFI_PASSWORD, (int)cachedWifiChannel, cachedWifiBssid);
-    for (int i = 0; i < 12 && WiFi.status() != WL_CONNECTED; i++) {
-      delay(500);
-      Serial.print(".");
+    if (hasCachedIp) {
+      staticIp = WiFi.config(IPAddress(cachedIp[0]), IPAddress(cachedIp[1]),
+                             IPAddress(cachedIp[2]), IPAddress(cachedIp[3]));
     }
-    wifiConnected = (WiFi.status() == WL_CONNECTED);
+    wifiBegin(WIFI_SSID, WIFI_PASSWORD, (int)cachedWifiChannel, cachedWifiBssid);
+    wifiConnected = wifiWaitUp(WIFI_CACHED_CONNECT_MS, true);
     if (!wifiConnected) {
-      Serial.println("\nCached connect failed, falling back to scan");
+      Serial.println("Cached connect failed, falling back to scan");
       WiFi.disconnect(false);
-      delay(200);
+      if (staticIp) {
+        WiFi.config(IPAddress(), IPAddress(), IPAddress()); // back to DHCP
+        staticIp = false;
+      }
     }
   }
 
@@ -532,82 +1294,159 @@ bool syncTimeWithNTP() {
       int ch = WiFi.channel(targetIdx);
       Serial.printf("Target on ch%d %d dBm %s - pinning\n", ch,
                     WiFi.RSSI(targetIdx), WiFi.BSSIDstr(targetIdx).c_str());
-      WiFi.begin(WIFI_SSID, WIFI_PASSWORD, ch, bssid);
+      wifiBegin(WIFI_SSID, WIFI_PASSWORD, ch, bssid);
     } else {
       Serial.printf("'%s' not found in scan - blind connect\n", WIFI_SSID);
-      WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+      wifiBegin(WIFI_SSID, WIFI_PASSWORD);
     }
     WiFi.scanDelete();
-
-    for (int i = 0; i < 30 && WiFi.status() != WL_CONNECTED; i++) {
-      delay(500);
-      Serial.print(".");
-    }
-    wifiConnected = (WiFi.status() == WL_CONNECTED);
+    wifiConnected = wifiWaitUp(WIFI_SCAN_CONNECT_MS, false);
   }
 
   // Attempt C: blind connect, max TX power — WiFi 6 band-steering fallback
   if (!wifiConnected) {
-    Serial.println("\nScan connect failed. Retrying blind, max TX...");
+    Serial.println("Scan connect failed. Retrying blind, max TX...");
     WiFi.disconnect(false);
-    delay(300);
     WiFi.setTxPower(WIFI_POWER_19_5dBm);
-    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
-    for (int i = 0; i < 20 && WiFi.status() != WL_CONNECTED; i++) {
-      delay(500);
-      Serial.print(".");
-    }
-    wifiConnected = (WiFi.status() == WL_CONNECTED);
+    wifiBegin(WIFI_SSID, WIFI_PASSWORD);
+    wifiConnected = wifiWaitUp(WIFI_BLIND_CONNECT_MS, false);
   }
 
   if (!wifiConnected) {
-    Serial.printf("\nFailed. Final Status: %d\n", WiFi.status());
+    Serial.printf("Failed. Final Status: %d\n", WiFi.status());
+    ntpFailStreak++;
     WiFi.disconnect(true);
     WiFi.mode(WIFI_OFF);
     return false;
   }
 
-  Serial.printf("\nConnected. IP=%s RSSI=%d dBm CH=%d\n",
-                WiFi.localIP().toString().c_str(), WiFi.RSSI(),
-                WiFi.channel());
+  Serial.printf("Connected. IP=%s%s RSSI=%d dBm CH=%d\n",
+                WiFi.localIP().toString().c_str(), staticIp ? " (cached)" : "",
+                WiFi.RSSI(), WiFi.channel());
 
   // Cache channel + BSSID for faster connect next time
   cachedWifiChannel = WiFi.channel();
   uint8_t *connBssid = WiFi.BSSID();
   memcpy(cachedWifiBssid, connBssid, 6);
   hasCachedWifi = true;
+  if (!staticIp) {
+    cachedIp[0] = WiFi.localIP();
+    cachedIp[1] = WiFi.gatewayIP();
+    cachedIp[2] = WiFi.subnetMask();
+    cachedIp[3] = WiFi.dnsIP();
+    hasCachedIp = cachedIp[0] != 0;
+  }
 
-  // ---- 5. NTP ----
+  // ---- 5. NTP: one raw SNTP exchange ----
+  // The resolved server address is cached too; a failed exchange re-resolves
+  // once in case the pool rotated the host away
   Serial.println("Syncing NTP...");
-  configTzTime(TZ_STRING, NTP_SERVER);
-
-  struct tm timeinfo;
-  if (!getLocalTime(&timeinfo, 10000)) {
+  int64_t ntpUs = 0, atUs = 0;
+  bool synced = false;
+  for (int attempt = 0; attempt < 2 && !synced; attempt++) {
+    if (cachedNtpIp == 0 || attempt > 0) {
+      IPAddress resolved;
+      cachedNtpIp = WiFi.hostByName(NTP_SERVER, resolved) ? (uint32_t)resolved : 0;
+    }
+    synced = cachedNtpIp != 0 && sntpQuery(cachedNtpIp, ntpUs, atUs);
+  }
+  if (!synced) {
     Serial.println("NTP Sync Failed");
+    ntpFailStreak++;
+    cachedNtpIp = 0;
+    hasCachedIp = false; // the reused lease may be what broke it
     WiFi.disconnect(true);
     WiFi.mode(WIFI_OFF);
     return false;
   }
 
-  rtc.setTimeStruct(timeinfo);
+  struct timeval before;
+  gettimeofday(&before, nullptr);
+  int64_t trueUs = ntpUs + (esp_timer_get_time() - atUs);
+  double offsetS =
+      (trueUs - ((int64_t)before.tv_sec * 1000000 + before.tv_usec)) / 1e6;
+  struct timeval tv = {(time_t)(trueUs / 1000000), (suseconds_t)(trueUs % 1000000)};
+  settimeofday(&tv, nullptr);
+  recordNtpOffset(before.tv_sec, offsetS);
+  ntpRefEpoch = tv.tv_sec;
+  ntpFailStreak = 0;
   lastNtpSync = rtc.getEpoch();
-  saveSettings();
+
+  // ---- 6. Upload on the connection we already paid for ----
+  if (deferUpload && UPLOAD_URL[0] != '\0') {
+    uploadDeferred = true;
+    return true;
+  }
+  uploadPendingReadings();
+  saveSettings(); // persists the upload cursor too
 
   WiFi.disconnect(true);
   WiFi.mode(WIFI_OFF);
   return true;
 }
 
+// Seconds between syncs: the fixed staleness interval until the drift is
+// known, then however long it takes to drift NTP_MAX_ERROR_S
+uint32_t ntpIntervalS() {
+  if (!driftValid)
+    return NTP_STALENESS_INTERVAL;
+  float s = NTP_MAX_ERROR_S * 1e6f / max(fabsf(driftPpm), 0.1f);
+  return (uint32_t)constrain(s, (float)NTP_MIN_INTERVAL_S,
+                             (float)NTP_MAX_INTERVAL_S);
+}
+
+float ntpProjectedErrorS(time_t now) {
+  return fabsf(driftPpm) * (now - lastNtpSync) / 1e6f;
+}
+
+bool ntpDue() {
+  return lastNtpSync == 0 ||
+         rtc.getEpoch() - lastNtpSync > (time_t)ntpIntervalS();
+}
+
+// Background wakes may defer a due sync. Failed attempts back off
+// exponentially. A known-small error also waits while NTP would take more
+// than NTP_BUDGET_SHARE of the projected daily charge. User wakes always
+// sync, since they show the time.
+bool ntpBackgroundAllowed(time_t now) {
+  if (ntpFailStreak > 0 &&
+      now - lastNtpAttempt < (time_t)NTP_MIN_INTERVAL_S << min<int>(ntpFailStreak, 5))
+    return false;
+  if (driftValid && lastNtpSync != 0 &&
+      ntpProjectedErrorS(now) < NTP_HARD_ERROR_S) {
+    PowerBudget b = powerBudget();
+    float ntpMahPerDay = b.ntpMas * 86400.0f / ntpIntervalS() / 3600.0f;
+    if (b.mAhPerDay > 0 && ntpMahPerDay > NTP_BUDGET_SHARE * b.mAhPerDay)
+      return false;
+  }
+  return true;
+}
+
+// Silent form of shouldSyncNtp() for the fast background path
+bool ntpWanted() {
+  return ntpDue() && (!backgroundReading || ntpBackgroundAllowed(rtc.getEpoch()));
+}
+
 bool shouldSyncNtp() {
   time_t now = rtc.getEpoch();
 
-  if (lastNtpSync == 0 || (now - lastNtpSync > NTP_STALENESS_INTERVAL)) {
+  if (ntpDue()) {
+    if (backgroundReading && !ntpBackgroundAllowed(now)) {
+      Serial.printf("NTP: Due, deferred on background wake (%d failed)\n",
+                    ntpFailStreak);
+      return false;
+    }
     Serial.println("NTP: Never synced or is stale, attempting...");
     return true;
   }
 
-  Serial.printf("NTP: Last sync %ld seconds ago, skipping\n",
-                now - lastNtpSync);
+  Serial.printf("NTP: Last sync %ld seconds ago, next in %lds",
+                (long)(now - lastNtpSync),
+                (long)(lastNtpSync + ntpIntervalS() - now));
+  if (driftValid)
+    Serial.printf(" (drift %+.1f ppm, ~%.2f s off)", driftPpm,
+                  ntpProjectedErrorS(now));
+  Serial.println();
   return false;
 }
 
@@ -704,168 +1543,1072 @@ void saveTimeEdit() {
   rtc.setTime(newUtc);
   // Mark as recently-set so we don't immediately overwrite via NTP next boot
   lastNtpSync = newUtc;
+  ntpRefEpoch = 0; // the next sync's offset says nothing about drift
+
   saveSettings();
   Serial.printf("Manual time set: UTC epoch = %ld\n", (long)newUtc);
 }
 
+// ---- Direct register access ----
+// Measurements bypass the library: it busy-waits on the status register and
+// reads each channel in its own transaction. Here a conversion is one
+// register write, a wait, and one 8-byte burst read.
+
+#define BME280_REG_CHIP_ID 0xD0
+#define BME280_CHIP_ID 0x60
+#define BME280_REG_CALIB_TP 0x88 // 0x88..0x9F, then H1 at 0xA1
+#define BME280_REG_CALIB_H 0xE1  // 0xE1..0xE7
+#define BME280_REG_CTRL_HUM 0xF2
+#define BME280_REG_STATUS 0xF3
+#define BME280_REG_CTRL_MEAS 0xF4
+#define BME280_REG_DATA 0xF7 // press[3] temp[3] hum[2]
+#define BME280_REG_CONFIG 0xF5
+#define BME280_CTRL_HUM_X1 0x01
+#define BME280_CTRL_MEAS_FORCED_X1 0x25 // osrs_t = osrs_p = X1, forced mode
+
+// Oversampling per conversion, as osrs register codes (1 = X1 ... 5 = X16).
+// Logged readings use SENSOR_LOG_PROFILE, the awake overview refresh
+// SENSOR_LIVE_PROFILE. The IIR filter stays off in all of them: in forced
+// mode it blends each conversion into the previous one, which on a timer
+// wake is a whole interval old.
+struct BmeProfileConfig {
+  const char *name;
+  uint8_t osrsT, osrsP, osrsH;
+};
+const BmeProfileConfig BME_PROFILES[BME_PROFILE_COUNT] = {
+    {"low-power", 1, 1, 1}, // T/P/H X1/X1/X1, 9.3 ms
+    {"standard", 2, 3, 1},  // X2/X4/X1, 18.5 ms: halves pressure noise
+    {"precise", 3, 5, 3},   // X4/X16/X4, 57.6 ms
+};
+
+// Datasheet 9.1 maximum measurement time for a profile
+static uint32_t bmeMeasureUs(const BmeProfileConfig &p) {
+  auto os = [](uint8_t code) { return code ? 1u << (code - 1) : 0u; };
+  return 1250 + 2300 * os(p.osrsT) + 2300 * os(p.osrsP) + 575 +
+         2300 * os(p.osrsH) + 575;
+}
+
+static bool bmeWrite(uint8_t reg, uint8_t value) {
+  I2cBusGuard bus;
+  Wire.beginTransmission(BME280_I2C_ADDR);
+  Wire.write(reg);
+  Wire.write(value);
+  return Wire.endTransmission() == 0;
+}
+
+static bool bmeRead(uint8_t reg, uint8_t *buf, size_t len) {
+  I2cBusGuard bus;
+  Wire.beginTransmission(BME280_I2C_ADDR);
+  Wire.write(reg);
+  if (Wire.endTransmission(false) != 0 ||
+      Wire.requestFrom((uint8_t)BME280_I2C_ADDR, (uint8_t)len) != len)
+    return false;
+  for (size_t i = 0; i < len; i++)
+    buf[i] = Wire.read();
+  return true;
+}
+
+static uint16_t le16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+bool bmeLoadCalib() {
+  uint8_t tp[26], h[7];
+  if (!bmeRead(BME280_REG_CALIB_TP, tp, sizeof(tp)) ||
+      !bmeRead(BME280_REG_CALIB_H, h, sizeof(h))) {
+    bmeCalibValid = false;
+    return false;
+  }
+  Bme280Calib &c = bmeCalib;
+  c.T1 = le16(tp + 0);
+  c.T2 = (int16_t)le16(tp + 2);
+  c.T3 = (int16_t)le16(tp + 4);
+  c.P1 = le16(tp + 6);
+  c.P2 = (int16_t)le16(tp + 8);
+  c.P3 = (int16_t)le16(tp + 10);
+  c.P4 = (int16_t)le16(tp + 12);
+  c.P5 = (int16_t)le16(tp + 14);
+  c.P6 = (int16_t)le16(tp + 16);
+  c.P7 = (int16_t)le16(tp + 18);
+  c.P8 = (int16_t)le16(tp + 20);
+  c.P9 = (int16_t)le16(tp + 22);
+  c.H1 = tp[25]; // 0xA1
+  c.H2 = (int16_t)le16(h + 0);
+  c.H3 = h[2];
+  c.H4 = (int16_t)(((int8_t)h[3] * 16) | (h[4] & 0x0F));
+  c.H5 = (int16_t)(((int8_t)h[5] * 16) | (h[4] >> 4));
+  c.H6 = (int8_t)h[6];
+  bmeCalibValid = true;
+  return true;
+}
+
+// Light-sleep through a short fixed wait with only the timer armed
+static void napUs(uint32_t us) {
+  esp_sleep_enable_timer_wakeup(us);
+  chargeAccount();
+  powerLightSleep = true;
+  esp_light_sleep_start();
+  chargeAccount();
+  powerLightSleep = false;
+  esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TIMER);
+}
+
+// Integer compensation from datasheet 4.2.3 (32-bit T/H, 64-bit P)
+static void bmeCompensate(int32_t adcT, int32_t adcP, int32_t adcH,
+                          SensorData &out) {
+  const Bme280Calib &c = bmeCalib;
+  int32_t v1 = ((((adcT >> 3) - ((int32_t)c.T1 << 1))) * c.T2) >> 11;
+  int32_t v2 = (((((adcT >> 4) - (int32_t)c.T1) *
+                  ((adcT >> 4) - (int32_t)c.T1)) >> 12) * c.T3) >> 14;
+  int32_t tFine = v1 + v2;
+  out.temperature = ((tFine * 5 + 128) >> 8) / 100.0f;
+
+  int64_t p1 = (int64_t)tFine - 128000;
+  int64_t p2 = p1 * p1 * c.P6;
+  p2 += (p1 * c.P5) << 17;
+  p2 += (int64_t)c.P4 << 35;
+  p1 = ((p1 * p1 * c.P3) >> 8) + ((p1 * c.P2) << 12);
+  p1 = ((((int64_t)1) << 47) + p1) * c.P1 >> 33;
+  if (p1 == 0) {
+    out.pressure = 0;
+  } else {
+    int64_t pa = 1048576 - adcP;
+    pa = (((pa << 31) - p2) * 3125) / p1;
+    p1 = ((int64_t)c.P9 * (pa >> 13) * (pa >> 13)) >> 25;
+    p2 = ((int64_t)c.P8 * pa) >> 19;
+    pa = ((pa + p1 + p2) >> 8) + ((int64_t)c.P7 << 4); // Q24.8 Pa
+    out.pressure = pa / 25600.0f;
+  }
+
+  int32_t h = tFine - 76800;
+  h = (((((adcH << 14) - ((int32_t)c.H4 << 20) - ((int32_t)c.H5 * h)) +
+         16384) >> 15) *
+       (((((((h * c.H6) >> 10) * (((h * (int32_t)c.H3) >> 11) + 32768)) >>
+           10) + 2097152) * c.H2 + 8192) >> 14));
+  h -= (((((h >> 15) * (h >> 15)) >> 7) * (int32_t)c.H1) >> 4);
+  h = constrain(h, 0, 419430400);
+  out.humidity = (h >> 12) / 1024.0f; // Q22.10 %RH
+}
+
+// Raw data block (0xF7..0xFE) to physical units; false if unconverted
+static bool bmeDecode(const uint8_t raw[8], SensorData &out) {
+  int32_t adcP = ((uint32_t)raw[0] << 12) | (raw[1] << 4) | (raw[2] >> 4);
+  int32_t adcT = ((uint32_t)raw[3] << 12) | (raw[4] << 4) | (raw[5] >> 4);
+  int32_t adcH = (raw[6] << 8) | raw[7];
+  if (adcT == 0x80000) // conversion never ran (reset value)
+    return false;
+  bmeCompensate(adcT, adcP, adcH, out);
+  return true;
+}
+
+// One forced conversion at a profile's oversampling. sleepWait
+// light-sleeps through the conversion time (background wakes); otherwise
+// the task just yields for it.
+bool bmeMeasure(SensorData &out, BmeProfile profile, bool sleepWait) {
+  const BmeProfileConfig &p = BME_PROFILES[profile];
+  uint8_t ctrlMeas = (p.osrsT << 5) | (p.osrsP << 2) | 0x01; // forced
+  if (!bmeCalibValid || !bmeWrite(BME280_REG_CTRL_HUM, p.osrsH) ||
+      !bmeWrite(BME280_REG_CTRL_MEAS, ctrlMeas))
+    return false;
+  uint32_t waitUs = bmeMeasureUs(p);
+  if (sleepWait)
+    napUs(waitUs);
+  else
+    delay((waitUs + 999) / 1000);
+
+  uint8_t status = 0;
+  for (int tries = 0; tries < 5; tries++) {
+    if (!bmeRead(BME280_REG_STATUS, &status, 1))
+      return false;
+    if (!(status & 0x08)) // measuring
+      break;
+    delay(1);
+  }
+
+  uint8_t raw[8];
+  return bmeRead(BME280_REG_DATA, raw, sizeof(raw)) && bmeDecode(raw, out);
+}
+
 void initSensor() {
+  PROFILE_SCOPE(PH_SENSOR_INIT);
   Serial.println("Initializing BME280...");
-  if (!bme.begin(0x76, &Wire)) {
+  bool found;
+  {
+    I2cBusGuard bus; // the flush task is already running
+    found = bme.begin(BME280_I2C_ADDR, &Wire);
+  }
+  if (!found || !bmeLoadCalib()) {
     Serial.println("BME280 not found");
     sensorAvailable = false;
     return;
   }
-  sensorAvailable = true;
-  // Forced mode: sensor takes one measurement then sleeps at ~3µA (vs ~1mA normal)
-  bme.setSampling(Adafruit_BME280::MODE_FORCED,
-                  Adafruit_BME280::SAMPLING_X1,
-                  Adafruit_BME280::SAMPLING_X1,
-                  Adafruit_BME280::SAMPLING_X1,
-                  Adafruit_BME280::FILTER_OFF,
-                  Adafruit_BME280::STANDBY_MS_0_5);
-  Serial.println("BME280 OK");
+  // begin() leaves the sensor in normal mode; park it in sleep (~0.1µA vs
+  // ~1mA) with the filter off. Each bmeMeasure() then sets its profile's
+  // oversampling along with the forced-mode trigger.
+  sensorAvailable = bmeWrite(BME280_REG_CTRL_MEAS, 0x00) &&
+                    bmeWrite(BME280_REG_CONFIG, 0x00);
+  Serial.printf("BME280 %s (log %s, live %s)\n",
+                sensorAvailable ? "OK" : "config failed",
+                BME_PROFILES[SENSOR_LOG_PROFILE].name,
+                BME_PROFILES[SENSOR_LIVE_PROFILE].name);
 }
 
 // ========== Flash Persistence ==========
 
-void loadRamBuffer() {
-  if (!LittleFS.begin(true)) {
-    Serial.println("LittleFS mount failed");
+// Mount LittleFS without the library's format-on-failure. A partition that
+// has mounted before (the "fsMounted" preference) is never formatted
+// implicitly: a failed mount after a brownout leaves the flash untouched and
+// the readings staged in RTC memory, to be retried on the next flush. Only
+// a partition that never mounted (new device, fresh flash) is formatted, or
+// any partition when the caller is wiping the data anyway (allowFormat).
+bool mountStorage(bool allowFormat = false) {
+  if (LittleFS.begin(false)) {
+    if (!storageMarked) {
+      prefs.begin("settings", false);
+      if (!prefs.getBool("fsMounted", false))
+        prefs.putBool("fsMounted", true);
+      prefs.end();
+      storageMarked = true;
+    }
+    return true;
+  }
+  prefs.begin("settings", true);
+  bool mountedBefore = prefs.getBool("fsMounted", false);
+  prefs.end();
+  if (mountedBefore && !allowFormat) {
+    Serial.println("LittleFS mount failed; not formatting, data kept");
+    return false;
+  }
+  Serial.println(mountedBefore ? "Formatting LittleFS (clear)"
+                               : "Formatting new LittleFS partition");
+  return LittleFS.format() && LittleFS.begin(false);
+}
+
+// The history and rollup logs live in HistoryStore (lib/), behind its
+// Storage interface so they are also tested on the host; on the device they
+// go to LittleFS, mounted by the policy above. Every file read is counted in
+// storage.stats (see the test_storage_bench target).
+class DeviceStorage : public LittleFsStorage {
+public:
+  bool mount() override { return mountStorage(); }
+};
+DeviceStorage storage;
+
+SegmentLog historyLog(storage, HISTORY_LOG, historyLogState);
+SegmentLog rollupLogs[TIER_COUNT] = {
+    {storage, ROLLUP_LOGS[0], rollupLogState[0]},
+    {storage, ROLLUP_LOGS[1], rollupLogState[1]}};
+
+// Convert the raw SensorData /history.dat of earlier firmware into the log.
+// The old file is renamed first and removed only once the copy is complete,
+// so a power cut mid-way restarts the migration, into a fresh log, on the
+// next boot.
+static void migrateHistory() {
+  if (!storage.exists(HISTORY_LEGACY_FILE)) {
+    if (!storage.exists(HISTORY_FILE))
+      return;
+    storage.rename(HISTORY_FILE, HISTORY_LEGACY_FILE);
+  }
+  historyLog.remove(); // partial output of an interrupted run
+
+  int in = storage.open(HISTORY_LEGACY_FILE, Storage::READ);
+  HistoryWriter out(historyLog);
+  if (in < 0 || !out.open()) {
+    if (in >= 0)
+      storage.close(in);
+    Serial.println("History migration failed");
     return;
   }
+  Serial.println("Migrating history to packed format...");
+  uint32_t migrated = 0;
+  SensorData data;
+  uint32_t offset = 0;
+  while (storage.read(in, offset, &data, sizeof(data)) == sizeof(data)) {
+    if (!out.append(data))
+      break;
+    offset += sizeof(data);
+    migrated++;
+  }
+  out.close();
+  storage.close(in);
+  storage.remove(HISTORY_LEGACY_FILE);
+  Serial.printf("Migrated %lu entries\n", (unsigned long)migrated);
+}
+
+// ---- RTC recent-history cache ----
+// recentReadings plus the flash bookkeeping it mirrors (and the staged
+// readings not yet on flash) are sealed with a CRC after every load, append
+// or flush. A wake that finds the CRC intact
+// can draw from RTC memory without mounting LittleFS; a mismatch (cold boot,
+// brownout corruption, a failed write) forces loadRamBuffer().
+
+static uint32_t recentCacheCrc() {
+  uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)&recentReadings,
+                                  sizeof(recentReadings));
+  crc = esp_rom_crc32_le(crc, (const uint8_t *)&flashEntryCount,
+                         sizeof(flashEntryCount));
+  crc = esp_rom_crc32_le(crc, (const uint8_t *)&oldestTimestamp,
+                         sizeof(oldestTimestamp));
+  crc = esp_rom_crc32_le(crc, (const uint8_t *)&newestTimestamp,
+                         sizeof(newestTimestamp));
+  crc = esp_rom_crc32_le(crc, (const uint8_t *)&stagedReadings,
+                         sizeof(stagedReadings));
+  return crc;
+}
+
+static void sealRecentCache() { recentReadingsCrc = recentCacheCrc(); }
+
+static void invalidateRecentCache() { recentReadingsCrc = ~recentCacheCrc(); }
+
+bool recentCacheValid() { return recentReadingsCrc == recentCacheCrc(); }
+
+// Logical history length: flushed entries followed by staged ones
+uint32_t historyCount() { return flashEntryCount + stagedReadings.size(); }
+
+// ---- History view page cache ----
+// Settings -> History keeps the file open and its entries decoded in pages
+// of HISTORY_PAGE_RECORDS around historyIndex, so a scroll step within a
+// page costs no flash access at all. While the view is idle, prefetch()
+// loads the neighbouring page in the direction of travel, which keeps a
+// steady scroll through months of history at display speed. Entries in the
+// RTC window (the newest ones and the staged ones) are never paged: get()
+// leaves those to getHistoryEntry(). close() drops everything; callers do it
+// whenever indices shift (segment rotation, clear) and when the view is left.
+#define HISTORY_PAGE_RECORDS 32
+
+struct HistoryPage {
+  uint32_t first; // history index of items[0]
+  uint8_t count;  // 0: slot empty
+  SensorData items[HISTORY_PAGE_RECORDS];
+};
+
+class HistoryPageCache {
+public:
+  // Entry `index` from a cached page, loading the page on a miss. False for
+  // entries outside the paged range or if flash can't be read.
+  bool get(uint32_t index, SensorData &out) {
+    if (index >= pagedLimit())
+      return false;
+    if (index != lastIndex)
+      direction = index < lastIndex ? -1 : 1;
+    lastIndex = index;
+    HistoryPage *page = find(index);
+    if (!page) {
+      page = &pages[current ^ 1];
+      if (!load(*page, index - index % HISTORY_PAGE_RECORDS))
+        return false;
+    }
+    current = page - pages;
+    out = page->items[index - page->first];
+    return true;
+  }
+
+  // Idle work: load the page after (or before) the current one if it isn't
+  // cached yet, overwriting the other slot. True if a page was read.
+  bool prefetch() {
+    const HistoryPage &cur = pages[current];
+    if (cur.count == 0)
+      return false;
+    uint32_t first;
+    if (direction < 0) {
+      if (cur.first == 0)
+        return false;
+      first = cur.first - HISTORY_PAGE_RECORDS;
+    } else {
+      first = cur.first + HISTORY_PAGE_RECORDS;
+      if (first >= pagedLimit())
+        return false;
+    }
+    if (find(first))
+      return false;
+    return load(pages[current ^ 1], first);
+  }
+
+  void close() {
+    reader.close();
+    pages[0].count = 0;
+    pages[1].count = 0;
+  }
+
+private:
+  // Entries below this are only on flash; the rest are in recentReadings
+  static uint32_t pagedLimit() {
+    uint32_t ramFirst = historyCount() - recentReadings.size();
+    return min(ramFirst, flashEntryCount);
+  }
+
+  HistoryPage *find(uint32_t index) {
+    for (HistoryPage &p : pages) {
+      if (p.count > 0 && index >= p.first && index < p.first + p.count)
+        return &p;
+    }
+    return nullptr;
+  }
+
+  // One sequential pass through the reader: a page spans at most two of
+  // its 256-byte blocks, each fetched with a single read
+  bool load(HistoryPage &page, uint32_t first) {
+    page.count = 0;
+    if (!reader.open())
+      return false;
+    uint32_t end = min(first + HISTORY_PAGE_RECORDS, reader.size());
+    for (uint32_t i = first; i < end; i++) {
+      if (!reader.read(i, page.items[i - first]))
+        return false;
+    }
+    page.first = first;
+    page.count = end > first ? end - first : 0;
+    return page.count > 0;
+  }
+
+  HistoryReader reader{historyLog};
+  HistoryPage pages[2];
+  uint8_t current = 0; // slot holding lastIndex
+  uint32_t lastIndex = 0;
+  int8_t direction = -1; // the view opens on the newest entry, so older first
+};
+
+HistoryPageCache historyView;
+
+// Drop cached graph windows containing ts (or all of them by default)
+static void seriesCacheInvalidate(time_t ts = -1) {
+  for (int i = 0; i < SERIES_CACHE_SLOTS; i++) {
+    SeriesCacheEntry &e = seriesCache[i];
+    if (ts < 0 || (ts >= e.startTime && ts <= e.endTime))
+      e.valid = false;
+  }
+}
+
+// ---- Rollups (hourly / daily aggregates) ----
+
+// Held open while a flush or a replay persists periods, so each tier gets
+// one sequential append per batch; rollupSinksClose() commits them
+static LogWriter rollupSink[TIER_COUNT];
+
+static void rollupPersist(int tier, const RollupRecord &rec) {
+  if (!rollupSink[tier].open(rollupLogs[tier])) {
+    Serial.printf("Failed to open %s\n", ROLLUP_LOGS[tier].dir);
+    return;
+  }
+  rollupSink[tier].append(&rec);
+}
+
+static void rollupSinksClose() {
+  for (int t = 0; t < TIER_COUNT; t++) {
+    rollupSink[t].close();
+  }
+}
+
+// Fold one reading into a tier's open period, persisting it once the
+// reading falls into the next period.
+static void rollupFold(int tier, const SensorData &data) {
+  RollupRecord done;
+  if (rollupAdd(rollupOpen[tier], tier, data, done))
+    rollupPersist(tier, done);
+}
+
+// Rewrite a tier whose records were written under another channel set (or
+// before channel sets existed) into a log of the current layout, so
+// changing SENSOR_CHANNELS keeps the tiers' years of history instead of
+// rebuilding them from the much shorter raw history. Channels the old
+// records lack come out NaN. Writes to ROLLUP_TMP_DIR and renames it into
+// place. False if there is nothing to migrate.
+static bool rollupMigrate(int tier) {
+  SegmentLog &log = rollupLogs[tier];
+  LogMeta meta;
+  if (!log.readMeta(meta) || meta.magic != ROLLUP_MAGIC ||
+      meta.version != ROLLUP_VERSION || meta.slotBytes == 0)
+    return false;
+  uint32_t oldMask = meta.layout ? meta.layout : ROLLUP_LEGACY_CHANNELS;
+  if (meta.slotBytes != 8 + bitCount(oldMask) * sizeof(ChannelStats))
+    return false;
+  LogSpec oldSpec = log.spec;
+  oldSpec.slotBytes = meta.slotBytes;
+  oldSpec.layout = meta.layout;
+  LogState oldState;
+  SegmentLog oldLog(storage, oldSpec, oldState);
+  oldLog.forget();
+  if (!oldLog.mount())
+    return false;
+  uint32_t used = oldLog.size();
+
+  LogSpec tmpSpec = log.spec;
+  tmpSpec.dir = ROLLUP_TMP_DIR;
+  LogState tmpState;
+  SegmentLog tmpLog(storage, tmpSpec, tmpState);
+  tmpLog.remove(); // leftover of an interrupted run
+  LogWriter out;
+  LogCursor cursor;
+  bool ok = out.open(tmpLog);
+  uint8_t raw[8 + SERIES_CHANNELS * sizeof(ChannelStats)];
+  for (uint32_t i = 0; ok && i < used; i++) {
+    ok = cursor.read(oldLog, oldLog.firstSlot() + i, raw, oldSpec.slotBytes) ==
+         oldSpec.slotBytes;
+    RollupRecord rec;
+    memcpy(&rec, raw, 8); // periodStart, count
+    const ChannelStats *src = (const ChannelStats *)(raw + 8);
+    for (int c = 0, k = 0; c < SERIES_CHANNELS; c++) {
+      bool had = oldMask & (1u << c);
+      if (channelEnabled(c)) {
+        ChannelStats &st = rec.stats[channelSlot(c)];
+        if (had)
+          memcpy(&st, &src[k], sizeof(st));
+        else
+          st.minVal = st.maxVal = st.mean = NAN;
+      }
+      k += had;
+    }
+    ok = ok && out.append(&rec);
+  }
+  out.close();
+  cursor.close();
+  if (ok) {
+    log.remove();
+    ok = storage.rename(ROLLUP_TMP_DIR, log.spec.dir);
+  } else {
+    tmpLog.remove();
+  }
+  LOG("Rollup %s: %lu periods %s to channels 0x%02lx\n", log.spec.dir,
+      (unsigned long)used, ok ? "migrated" : "failed to migrate",
+      (unsigned long)ENABLED_CHANNELS);
+  return ok;
+}
+
+// The open periods live in RTC memory and are lost on power loss, and files
+// written before rollups existed have none at all. Rebuild by replaying the
+// raw readings newer than the last persisted period of each tier. Rollup
+// logs that can't be read or migrated are rebuilt too.
+static void rollupRecover() {
+  uint32_t resumeAfter[TIER_COUNT];
+  uint32_t scanFrom = UINT32_MAX;
+  for (int t = 0; t < TIER_COUNT; t++) {
+    rollupOpen[t].count = 0;
+    resumeAfter[t] = 0;
+    RecordReader<RollupRecord> tierReader(rollupLogs[t]);
+    RollupRecord last;
+    if (tierReader.open() || (rollupMigrate(t) && tierReader.open())) {
+      if (tierReader.size() > 0 &&
+          tierReader.read(tierReader.size() - 1, last))
+        resumeAfter[t] = last.periodStart + TIER_SECONDS[t];
+    } else {
+      rollupLogs[t].remove();
+    }
+    scanFrom = min(scanFrom, resumeAfter[t]);
+  }
 
-  File file = LittleFS.open("/history.dat", FILE_READ);
-  if (!file) {
+  HistoryReader reader(historyLog);
+  if (reader.open() && reader.size() > 0) {
+    // Start at the first reading any tier still needs
+    uint32_t i = reader.lowerBound((time_t)scanFrom);
+    SensorData data;
+    uint32_t replayed = 0;
+    for (; i < reader.size() && reader.read(i, data); i++) {
+      for (int t = 0; t < TIER_COUNT; t++) {
+        if ((uint32_t)data.timestamp >= resumeAfter[t])
+          rollupFold(t, data);
+      }
+      replayed++;
+    }
+    rollupSinksClose();
+    LOG("Rollups rebuilt from %lu readings\n", (unsigned long)replayed);
+  }
+  rollupsValid = true;
+}
+
+void loadRamBuffer() {
+  PROFILE_SCOPE(PH_LOAD_HISTORY);
+  if (!mountStorage())
+    return;
+
+  migrateHistory();
+
+  // Only called when the RTC state failed its CRC, so staged readings
+  // can't be trusted either
+  if (!stagedReadings.empty())
+    Serial.printf("Dropping %d unverified staged readings\n",
+                  stagedReadings.size());
+  stagedReadings.clear();
+
+  HistoryReader reader(historyLog);
+  if (!reader.open()) {
     Serial.println("No history file");
     flashEntryCount = 0;
-    ramBufferCount = 0;
+    oldestTimestamp = 0;
+    newestTimestamp = 0;
+    recentReadings.clear();
+    sealRecentCache();
+    return;
+  }
+
+  flashEntryCount = reader.size();
+  recentReadings.clear();
+
+  uint32_t first =
+      flashEntryCount - min(flashEntryCount, (uint32_t)RAM_BUFFER_SIZE);
+  SensorData data;
+  for (uint32_t i = first; i < flashEntryCount && reader.read(i, data); i++) {
+    recentReadings.push(data);
+  }
+  if (!recentReadings.empty()) {
+    newestTimestamp = recentReadings.back().timestamp;
+    if (reader.read(0, data))
+      oldestTimestamp = data.timestamp;
+  }
+
+  sealRecentCache();
+
+  LOG("Loaded %d entries (total: %lu)\n", recentReadings.size(),
+      (unsigned long)flashEntryCount);
+}
+
+// Append every staged reading to the history log in one batch and
+// fold them into the rollups. Returns false (keeping what didn't make it)
+// if flash is unavailable.
+bool flushStagedReadings() {
+  if (stagedReadings.empty())
+    return true;
+  PROFILE_SCOPE(PH_FLASH_FLUSH);
+
+  if (!mountStorage())
+    return false;
+
+  if (!rollupsValid)
+    rollupRecover();
+
+  HistoryWriter writer(historyLog);
+  if (!writer.open()) {
+    Serial.println("Failed to open history file");
+    return false;
+  }
+  if (writer.trimmedTail())
+    Serial.printf("History tail block failed its check, trimmed %u entries\n",
+                  writer.trimmedEntries());
+  uint16_t written = 0;
+  while (written < stagedReadings.size()) {
+    const SensorData &data = stagedReadings[written];
+    if (!writer.append(data))
+      break;
+    for (int t = 0; t < TIER_COUNT; t++) {
+      rollupFold(t, data);
+    }
+    written++;
+  }
+  if (!writer.close())
+    Serial.println("Failed to write history tail");
+  rollupSinksClose();
+
+  flashEntryCount += written;
+  if (writer.evictedBlocks() > 0 || writer.trimmedTail()) {
+    // The oldest segment was rotated out (indices shifted down) or a bad
+    // tail was cut, so reopen to recount and drop any cursor that still has
+    // the old layout
+    historyView.close();
+    HistoryReader reader(historyLog);
+    SensorData oldest;
+    if (reader.open() && reader.read(0, oldest)) {
+      flashEntryCount = reader.size();
+      oldestTimestamp = oldest.timestamp;
+    }
+    seriesCacheInvalidate();
+  }
+  stagedReadings.dropFront(written);
+  sealRecentCache();
+
+  LOG("Flushed %d readings (total: %lu)\n", written,
+      (unsigned long)flashEntryCount);
+  return stagedReadings.empty();
+}
+
+// Readings are staged in RTC memory and written in one append every
+// FLASH_BATCH_WAKES background wakes; an interactive wake flushes at once
+// so the UI session never runs with unsaved data.
+// deferFlush stages without the batch check; the caller flushes afterwards
+void logReading(const SensorData &data, bool deferFlush = false) {
+  if (stagedReadings.size() >= STAGING_CAPACITY && !flushStagedReadings()) {
+    Serial.println("Staging full and flash unavailable, reading dropped");
+    return;
+  }
+
+  stagedReadings.push(data);
+  recentReadings.push(data);
+  newestTimestamp = data.timestamp;
+  if (historyCount() == 1)
+    oldestTimestamp = data.timestamp;
+  sealRecentCache();
+  seriesCacheInvalidate(data.timestamp);
+
+  LOG("Logged #%lu (%d staged)\n", (unsigned long)historyCount(),
+      stagedReadings.size());
+
+  if (!deferFlush &&
+      (!backgroundReading || stagedReadings.size() >= FLASH_BATCH_WAKES)) {
+    flushStagedReadings();
+  }
+}
+
+// Fetch one entry, served from the RAM buffer when recent. Pass a reader to
+// keep the file open across calls; without one a temporary cursor is used.
+SensorData getHistoryEntry(int index, HistoryReader *reader = nullptr) {
+  // Check RAM buffer first (it mirrors the last size() logical entries,
+  // which always covers the staged ones)
+  uint32_t total = historyCount();
+  uint32_t ramFirst = total - recentReadings.size();
+  if (index >= 0 && (uint32_t)index >= ramFirst && (uint32_t)index < total) {
+    return recentReadings[index - ramFirst];
+  }
+  if (index >= 0 && (uint32_t)index >= flashEntryCount &&
+      (uint32_t)index < total) {
+    return stagedReadings[index - flashEntryCount];
+  }
+
+  // Load from file
+  SensorData data = {0};
+  if (reader) {
+    if (reader->open())
+      reader->read(index, data);
+    return data;
+  }
+  HistoryReader oneShot(historyLog);
+  if (oneShot.open())
+    oneShot.read(index, data);
+  return data;
+}
+
+void readAndLogSensor() {
+  PROFILE_SCOPE(PH_READ_LOG);
+  if (!sensorAvailable) {
+    Serial.println("No sensor");
     return;
   }
 
-  flashEntryCount = file.size() / sizeof(SensorData);
-  ramBufferCount = min((int)flashEntryCount, RAM_BUFFER_SIZE);
+  SensorData data;
+  if (!bmeMeasure(data, SENSOR_LOG_PROFILE, backgroundReading)) {
+    Serial.println("Sensor read failed");
+    return;
+  }
+  data.timestamp = rtc.getEpoch();
+
+  logReading(data);
+
+  LOG("=== Reading ===\nT: %.1f C  H: %.0f%%  P: %.0fhPa  Time: %s  Entries: %lu\n",
+      data.temperature, data.humidity, data.pressure,
+      rtc.getTime("%H:%M:%S").c_str(), (unsigned long)historyCount());
+}
 
-  if (ramBufferCount > 0) {
-    file.seek((flashEntryCount - ramBufferCount) * sizeof(SensorData));
-    for (int i = 0; i < ramBufferCount; i++) {
-      file.read((uint8_t *)&ramBuffer[i], sizeof(SensorData));
+bool readSensorLive(SensorData &out) {
+  if (!sensorAvailable || !bmeMeasure(out, SENSOR_LIVE_PROFILE, false))
+    return false;
+  out.timestamp = rtc.getEpoch();
+  return true;
+}
+
+void clearHistory() {
+  if (!mountStorage(true)) {
+    Serial.println("LittleFS mount failed (clear)");
+    return;
+  }
+  historyView.close();
+  historyLog.remove();
+  if (storage.exists(HISTORY_FILE)) {
+    storage.remove(HISTORY_FILE);
+  }
+  if (storage.exists(HISTORY_LEGACY_FILE)) {
+    storage.remove(HISTORY_LEGACY_FILE);
+  }
+  for (int t = 0; t < TIER_COUNT; t++) {
+    rollupLogs[t].remove();
+    rollupOpen[t].count = 0;
+  }
+  rollupsValid = true; // nothing left to replay
+  flashEntryCount = 0;
+  stagedReadings.clear();
+  recentReadings.clear();
+  oldestTimestamp = 0;
+  newestTimestamp = 0;
+  sealRecentCache();
+  seriesCacheInvalidate();
+  Serial.println("History cleared");
+}
+
+// ========== Batch Upload ==========
+// Readings logged since the last upload are POSTed to UPLOAD_URL while the
+// NTP sync has the radio up, so telemetry costs no wakes of its own. The
+// body is a run of ExportRecords (the "export bin" format, 12 bytes each),
+// at most UPLOAD_BATCH_RECORDS per request. The cursor is the timestamp of
+// the newest acknowledged reading rather than a file index, since indices
+// shift when the history log rotates out its oldest segment; the block index
+// finds it again in a few header reads.
+#define UPLOAD_BATCH_RECORDS 512 // 6 KB request body
+#define UPLOAD_MAX_BATCHES 4     // per radio window; the rest waits for the next
+#define UPLOAD_TIMEOUT_MS 4000
+
+void uploadPendingReadings() {
+  if (UPLOAD_URL[0] == '\0')
+    return;
+  HistoryReader reader(historyLog);
+  uint32_t total = historyCount();
+  uint32_t next = 0;
+  if (uploadedUntil > 0) {
+    next = reader.open() ? reader.lowerBound(uploadedUntil + 1) : 0;
+    while (next < total &&
+           getHistoryEntry(next, &reader).timestamp <= uploadedUntil)
+      next++; // within one block, or among the staged entries
+  }
+  if (next >= total) {
+    Serial.println("Upload: up to date");
+    return;
+  }
+
+  ExportRecord *batch =
+      (ExportRecord *)malloc(UPLOAD_BATCH_RECORDS * sizeof(ExportRecord));
+  if (!batch)
+    return;
+  HTTPClient http;
+  http.setReuse(true); // one keep-alive connection for all batches
+  http.setConnectTimeout(UPLOAD_TIMEOUT_MS);
+  http.setTimeout(UPLOAD_TIMEOUT_MS);
+  uint32_t sent = 0;
+  for (int b = 0; b < UPLOAD_MAX_BATCHES && next < total; b++) {
+    size_t n = 0;
+    uint32_t i = next;
+    time_t newest = uploadedUntil;
+    for (; n < UPLOAD_BATCH_RECORDS && i < total; i++) {
+      SensorData d = getHistoryEntry(i, &reader);
+      if (d.timestamp == 0)
+        continue; // entry couldn't be read
+      batch[n].timestamp = (uint32_t)d.timestamp;
+      batch[n].sample = packSample(d, batch[n].timestamp);
+      newest = max(newest, d.timestamp);
+      n++;
+    }
+    if (n == 0) {
+      next = i;
+      continue;
+    }
+    if (!http.begin(UPLOAD_URL))
+      break;
+    http.addHeader("Content-Type", "application/octet-stream");
+    http.addHeader("X-Record-Size", String(sizeof(ExportRecord)));
+    int code = http.POST((uint8_t *)batch, n * sizeof(ExportRecord));
+    http.end();
+    if (code < 200 || code >= 300) {
+      Serial.printf("Upload failed: HTTP %d\n", code);
+      break;
     }
-    newestTimestamp = ramBuffer[ramBufferCount - 1].timestamp;
-    file.seek(0);
-    SensorData first;
-    file.read((uint8_t *)&first, sizeof(SensorData));
-    oldestTimestamp = first.timestamp;
+    // A clock stepped back can put older entries last; the cursor never
+    // moves backwards
+    uploadedUntil = newest;
+    next = i;
+    sent += n;
   }
-  file.close();
+  free(batch);
+  Serial.printf("Upload: %lu readings sent, %lu pending\n", (unsigned long)sent,
+                (unsigned long)(total - next));
+}
 
-  LOG("Loaded %d entries (total: %lu)\n", ramBufferCount, flashEntryCount);
+// Finish a sync setup() started: upload once the history is loaded, then
+// drop the link syncTimeWithNTP(true) kept up
+void uploadAndDisconnect() {
+  RadioChargeScope radioCharge(false);
+  uploadDeferred = false;
+  uploadPendingReadings();
+  saveSettings(); // persists the upload cursor too
+  WiFi.disconnect(true);
+  WiFi.mode(WIFI_OFF);
 }
 
-void logReading(const SensorData &data) {
-  // Add to RAM buffer
-  if (ramBufferCount < RAM_BUFFER_SIZE) {
-    ramBuffer[ramBufferCount++] = data;
-  } else {
-    for (int i = 0; i < RAM_BUFFER_SIZE - 1; i++) {
-      ramBuffer[i] = ramBuffer[i + 1];
-    }
-    ramBuffer[RAM_BUFFER_SIZE - 1] = data;
-  }
+// ========== Wake Stub Sampling ==========
+// With WAKE_STUB_SAMPLES > 0 most timer wakes never boot the app: the
+// deep-sleep wake stub runs from RTC memory, bit-bangs a BME280 forced
+// conversion over the I2C pins and parks the raw data block in RTC memory.
+// A sample costs two stub wakes (trigger, then read once the conversion is
+// done) and no flash access. The app boots once the batch is in, on any
+// non-timer wake, or when the sensor stops acknowledging, and then logs
+// the batch with the timestamps the fixed interval implies.
+
+#if WAKE_STUB_SAMPLES > 0
+
+#define STUB_I2C_HALF_US 5     // ~100 kHz from the ROM delay loop
+#define STUB_CONVERT_US 10000  // > BME280_MEASURE_US
+#define STUB_PAD_REG(pin) (IO_MUX_GPIO0_REG + 4 * (pin)) // contiguous on C3
+#define STUB_SDA (1UL << I2C_SDA_PIN)
+#define STUB_SCL (1UL << I2C_SCL_PIN)
+
+struct StubSample {
+  uint8_t raw[8]; // BME280 0xF7..0xFE, decoded by the app
+};
 
-  // Append to flash file
-  if (!LittleFS.begin(true))
-    return;
+RTC_DATA_ATTR StubSample stubSamples[WAKE_STUB_SAMPLES];
+RTC_DATA_ATTR uint8_t stubCount = 0;
+RTC_DATA_ATTR uint8_t stubTarget = 0;
+RTC_DATA_ATTR bool stubConverting = false;
+RTC_DATA_ATTR uint64_t stubIntervalUs = 0;
+RTC_DATA_ATTR time_t stubSleepEpoch = 0; // sample i lands at +(i + 1) intervals
+
+// Everything below up to armWakeStub() runs before the app exists: only RTC
+// memory, ROM functions and direct register access are available (no
+// const tables either, they would land in flash).
+
+// The wake stub starts from pad reset state: I2C pins back to plain GPIO
+// with the output latch at 0 (open drain by toggling the enable bit), and
+// the wake pins' pull-ups reapplied for the next deep sleep
+static void RTC_IRAM_ATTR stubPadGpio(uint32_t pin) {
+  PIN_FUNC_SELECT(STUB_PAD_REG(pin), PIN_FUNC_GPIO);
+  PIN_INPUT_ENABLE(STUB_PAD_REG(pin));
+  REG_WRITE(GPIO_FUNC0_OUT_SEL_CFG_REG + 4 * pin, SIG_GPIO_OUT_IDX);
+}
 
-  File file = LittleFS.open("/history.dat", FILE_APPEND);
-  if (file) {
-    file.write((const uint8_t *)&data, sizeof(SensorData));
-    file.close();
-    flashEntryCount++;
+static void RTC_IRAM_ATTR stubPadPullup(uint32_t pin) {
+  PIN_INPUT_ENABLE(STUB_PAD_REG(pin));
+  PIN_PULLUP_EN(STUB_PAD_REG(pin));
+}
 
-    newestTimestamp = data.timestamp;
-    if (flashEntryCount == 1)
-      oldestTimestamp = data.timestamp;
+static void RTC_IRAM_ATTR stubPinsInit() {
+  stubPadGpio(I2C_SDA_PIN);
+  stubPadGpio(I2C_SCL_PIN);
+  REG_WRITE(GPIO_OUT_W1TC_REG, STUB_SDA | STUB_SCL);
+  REG_WRITE(GPIO_ENABLE_W1TC_REG, STUB_SDA | STUB_SCL);
+  stubPadPullup(ENCODER_SW_PIN);
+  stubPadPullup(ENCODER_CLK_PIN);
+  stubPadPullup(ENCODER_DT_PIN);
+  stubPadPullup(MODE_BUTTON_PIN);
+}
 
-    LOG("Logged #%lu\n", flashEntryCount);
-  } else {
-    Serial.println("Failed to open history file");
-  }
+static void RTC_IRAM_ATTR stubLine(uint32_t mask, bool high) {
+  REG_WRITE(high ? GPIO_ENABLE_W1TC_REG : GPIO_ENABLE_W1TS_REG, mask);
+  esp_rom_delay_us(STUB_I2C_HALF_US);
 }
 
-SensorData getHistoryEntry(int index) {
-  // Check RAM buffer first
-  if (index >= flashEntryCount - ramBufferCount && index < flashEntryCount) {
-    int ramIdx = ramBufferCount - (flashEntryCount - index);
-    return ramBuffer[ramIdx];
-  }
+static bool RTC_IRAM_ATTR stubSda() {
+  return (REG_READ(GPIO_IN_REG) & STUB_SDA) != 0;
+}
 
-  // Load from file
-  SensorData data = {0};
-  if (!LittleFS.begin())
-    return data;
+static void RTC_IRAM_ATTR stubStart() {
+  stubLine(STUB_SDA, true);
+  stubLine(STUB_SCL, true);
+  stubLine(STUB_SDA, false);
+  stubLine(STUB_SCL, false);
+}
+
+static void RTC_IRAM_ATTR stubStop() {
+  stubLine(STUB_SDA, false);
+  stubLine(STUB_SCL, true);
+  stubLine(STUB_SDA, true);
+}
 
-  File file = LittleFS.open("/history.dat", FILE_READ);
-  if (file) {
-    file.seek(index * sizeof(SensorData));
-    file.read((uint8_t *)&data, sizeof(SensorData));
-    file.close();
+static bool RTC_IRAM_ATTR stubWriteByte(uint8_t b) {
+  for (int i = 7; i >= 0; i--) {
+    stubLine(STUB_SDA, (b >> i) & 1);
+    stubLine(STUB_SCL, true);
+    stubLine(STUB_SCL, false);
   }
-  return data;
+  stubLine(STUB_SDA, true);
+  stubLine(STUB_SCL, true);
+  bool ack = !stubSda();
+  stubLine(STUB_SCL, false);
+  return ack;
 }
 
-void readAndLogSensor() {
-  if (!sensorAvailable) {
-    Serial.println("No sensor");
-    return;
+static uint8_t RTC_IRAM_ATTR stubReadByte(bool ack) {
+  uint8_t b = 0;
+  stubLine(STUB_SDA, true);
+  for (int i = 0; i < 8; i++) {
+    stubLine(STUB_SCL, true);
+    b = (b << 1) | stubSda();
+    stubLine(STUB_SCL, false);
   }
+  stubLine(STUB_SDA, !ack);
+  stubLine(STUB_SCL, true);
+  stubLine(STUB_SCL, false);
+  return b;
+}
 
-  SensorData data;
-  bme.takeForcedMeasurement();
-  data.temperature = bme.readTemperature();
-  data.humidity = bme.readHumidity();
-  data.pressure = bme.readPressure() / 100.0F;
-  data.timestamp = rtc.getEpoch();
+static bool RTC_IRAM_ATTR stubTrigger() {
+  stubStart();
+  bool ok = stubWriteByte(BME280_I2C_ADDR << 1) &&
+            stubWriteByte(BME280_REG_CTRL_HUM) &&
+            stubWriteByte(BME280_CTRL_HUM_X1) &&
+            stubWriteByte(BME280_REG_CTRL_MEAS) &&
+            stubWriteByte(BME280_CTRL_MEAS_FORCED_X1);
+  stubStop();
+  return ok;
+}
 
-  logReading(data);
+static bool RTC_IRAM_ATTR stubReadData(uint8_t *raw) {
+  stubStart();
+  bool ok = stubWriteByte(BME280_I2C_ADDR << 1) &&
+            stubWriteByte(BME280_REG_DATA);
+  if (ok) {
+    stubStart(); // repeated start
+    ok = stubWriteByte((BME280_I2C_ADDR << 1) | 1);
+  }
+  for (int i = 0; ok && i < 8; i++)
+    raw[i] = stubReadByte(i < 7);
+  stubStop();
+  return ok;
+}
 
-  LOG("=== Reading ===\nT: %.1f C  H: %.0f%%  P: %.0fhPa  Time: %s  Entries: %lu\n",
-      data.temperature, data.humidity, data.pressure,
-      rtc.getTime("%H:%M:%S").c_str(), flashEntryCount);
+static void RTC_IRAM_ATTR sampleWakeStub() {
+  if (esp_wake_stub_get_wakeup_cause() & RTC_TIMER_TRIG_EN) {
+    stubPinsInit();
+    if (stubConverting) {
+      stubConverting = false;
+      if (stubReadData(stubSamples[stubCount].raw)) {
+        stubCount++;
+        esp_wake_stub_set_wakeup_time(stubIntervalUs - STUB_CONVERT_US);
+        esp_wake_stub_sleep(&sampleWakeStub);
+      }
+    } else if (stubCount < stubTarget && stubTrigger()) {
+      stubConverting = true;
+      esp_wake_stub_set_wakeup_time(STUB_CONVERT_US);
+      esp_wake_stub_sleep(&sampleWakeStub);
+    }
+  }
+  esp_default_wake_deep_sleep(); // continue into a normal boot
 }
 
-bool readSensorLive(SensorData &out) {
-  if (!sensorAvailable)
-    return false;
-  bme.takeForcedMeasurement();
-  out.temperature = bme.readTemperature();
-  out.humidity = bme.readHumidity();
-  out.pressure = bme.readPressure() / 100.0F;
-  out.timestamp = rtc.getEpoch();
-  return true;
+// Hand the coming timer wakes to the stub, leaving the app one boot before
+// NTP goes stale. Needs the calibration to decode the batch afterwards.
+static void armWakeStub(uint64_t intervalUs) {
+  stubCount = 0;
+  stubConverting = false;
+  stubIntervalUs = intervalUs;
+  stubSleepEpoch = rtc.getEpoch();
+  time_t left = lastNtpSync + ntpIntervalS() - stubSleepEpoch;
+  uint64_t slots = left > 0 ? left * 1000000ULL / intervalUs : 0;
+  stubTarget = slots > 1 ? min<uint64_t>(slots - 1, WAKE_STUB_SAMPLES) : 0;
+  if (!sensorAvailable || !bmeCalibValid)
+    stubTarget = 0;
+  esp_set_deep_sleep_wake_stub(stubTarget > 0 ? &sampleWakeStub
+                                              : &esp_default_wake_deep_sleep);
 }
 
-void clearHistory() {
-  if (!LittleFS.begin(true)) {
-    Serial.println("LittleFS mount failed (clear)");
+// Log whatever the stub collected since the last boot; runs before this
+// boot's own reading so the history stays in time order
+void drainStubSamples() {
+  if (stubCount == 0)
     return;
+  LOG("Wake stub: %d samples\n", stubCount);
+  for (uint8_t i = 0; i < stubCount; i++) {
+    SensorData data;
+    if (!bmeDecode(stubSamples[i].raw, data))
+      continue;
+    data.timestamp =
+        stubSleepEpoch + (time_t)((i + 1) * stubIntervalUs / 1000000ULL);
+    logReading(data, true);
   }
-  if (LittleFS.exists("/history.dat")) {
-    LittleFS.remove("/history.dat");
-  }
-  flashEntryCount = 0;
-  ramBufferCount = 0;
-  oldestTimestamp = 0;
-  newestTimestamp = 0;
-  Serial.println("History cleared");
+  stubCount = 0;
 }
 
+#else
+void drainStubSamples() {}
+#endif // WAKE_STUB_SAMPLES
+
 // ========== Display Functions ==========
 
 void displayOverviewDefault() {
-  if (!displayAvailable || ramBufferCount == 0)
+  if (!displayAvailable || recentReadings.empty())
     return;
 
-  SensorData &data = hasLiveData ? liveData : ramBuffer[ramBufferCount - 1];
+  SensorData &data = hasLiveData ? liveData : recentReadings.back();
 
   display.clearDisplay();
 
@@ -920,7 +2663,7 @@ void displayOverviewDefault() {
   display.print("P:");
   display.print(data.pressure, 0);
 
-  display.display();
+  oledFlush();
 }
 
 // Helper: draw a single size-4 character (24 wide x 32 tall cell) at (x, y).
@@ -930,6 +2673,53 @@ static void drawClockChar(int x, int y, char c) {
   display.write(c);
 }
 
+// Big HH:MM band: 5 cells of 24 px = 120 px wide from x = 4, rows 16..47
+// (32 tall, display pages 2..5)
+#define CLOCK_X 4
+#define CLOCK_Y 16
+#define DIGIT_W 24
+#define DIGIT_H 32
+#define CLOCK_GLYPHS 11 // '0'..'9', ':'
+static_assert(CLOCK_Y % 8 == 0 && DIGIT_H == 32, "band is 4 whole pages");
+
+// Clock glyphs rendered once by GFX at size 4, one 32-row column per word
+// (bit k = row k of the cell). A frame then costs a shift and four byte
+// ORs per column instead of scaling the font pixel by pixel.
+static uint32_t clockAtlas[CLOCK_GLYPHS][DIGIT_W];
+static bool clockAtlasReady = false;
+
+static void buildClockAtlas() {
+  uint8_t *buf = display.getBuffer();
+  for (int g = 0; g < CLOCK_GLYPHS; g++) {
+    display.clearDisplay();
+    drawClockChar(0, 0, g < 10 ? '0' + g : ':');
+    for (int x = 0; x < DIGIT_W; x++) {
+      uint32_t col = 0;
+      for (int p = 0; p < 4; p++)
+        col |= (uint32_t)buf[x + p * SCREEN_WIDTH] << (8 * p);
+      clockAtlas[g][x] = col;
+    }
+  }
+  display.clearDisplay();
+  clockAtlasReady = true;
+}
+
+// OR a glyph into the band dy rows below its rest position; rows pushed
+// out of the band are clipped, which is what the minute slide needs
+static void blitClockGlyph(int x, int dy, char c) {
+  if (dy <= -DIGIT_H || dy >= DIGIT_H)
+    return;
+  const uint32_t *glyph = clockAtlas[c == ':' ? 10 : c - '0'];
+  uint8_t *band = display.getBuffer() + (CLOCK_Y / 8) * SCREEN_WIDTH + x;
+  for (int i = 0; i < DIGIT_W; i++) {
+    uint32_t col = dy >= 0 ? glyph[i] << dy : glyph[i] >> -dy;
+    band[i] |= col;
+    band[i + SCREEN_WIDTH] |= col >> 8;
+    band[i + 2 * SCREEN_WIDTH] |= col >> 16;
+    band[i + 3 * SCREEN_WIDTH] |= col >> 24;
+  }
+}
+
 // Big clock with minute slide-flip animation, date on top, T/H on bottom.
 void displayOverviewClock() {
   if (!displayAvailable)
@@ -938,8 +2728,8 @@ void displayOverviewClock() {
   SensorData fallback = {0};
   SensorData &data = hasLiveData
                          ? liveData
-                         : (ramBufferCount > 0 ? ramBuffer[ramBufferCount - 1]
-                                               : fallback);
+                         : (!recentReadings.empty() ? recentReadings.back()
+                                                    : fallback);
 
   time_t utc = rtc.getEpoch();
   struct tm timeinfo;
@@ -953,9 +2743,9 @@ void displayOverviewClock() {
     minuteSlideStart = millis();
   }
 
-  // Compute slide progress (0..1). When done, latch new minute.
+  // Compute slide progress in rows (0..DIGIT_H). When done, latch new minute.
   const unsigned long SLIDE_MS = 250;
-  float progress = 0.0f;
+  int slideRows = 0;
   bool sliding = false;
   if (minuteSliding) {
     unsigned long elapsed = millis() - minuteSlideStart;
@@ -963,53 +2753,44 @@ void displayOverviewClock() {
       minuteSliding = false;
       prevMinute = timeinfo.tm_min;
     } else {
-      progress = (float)elapsed / (float)SLIDE_MS;
+      slideRows = (int)(elapsed * DIGIT_H / SLIDE_MS);
       sliding = true;
     }
   }
 
+  if (!clockAtlasReady)
+    buildClockAtlas();
   display.clearDisplay();
 
   // ---- Big HH:MM band ----
-  // 5 cells of 24 px = 120 px wide, x_start = 4. Band y = 16..47 (32 tall).
-  const int CLOCK_Y = 16;
-  const int DIGIT_W = 24;
-  const int CLOCK_X = 4;
-  const int DIGIT_H = 32;
-
   int hh = timeinfo.tm_hour;
   int curMin = timeinfo.tm_min;
   int oldMin = (prevMinute >= 0) ? prevMinute : curMin;
 
   // Hours (static)
-  drawClockChar(CLOCK_X + 0 * DIGIT_W, CLOCK_Y, '0' + (hh / 10));
-  drawClockChar(CLOCK_X + 1 * DIGIT_W, CLOCK_Y, '0' + (hh % 10));
+  blitClockGlyph(CLOCK_X + 0 * DIGIT_W, 0, '0' + (hh / 10));
+  blitClockGlyph(CLOCK_X + 1 * DIGIT_W, 0, '0' + (hh % 10));
 
   // Colon (blink at 1 Hz; always on while sliding for steadier reading)
   bool colonOn = sliding || ((millis() / 500) % 2 == 0);
   if (colonOn) {
-    drawClockChar(CLOCK_X + 2 * DIGIT_W, CLOCK_Y, ':');
+    blitClockGlyph(CLOCK_X + 2 * DIGIT_W, 0, ':');
   }
 
-  // Minutes
+  // Minutes; the blit clips to the band, so the date row and T/H row stay
+  // clean during the slide animation
   if (sliding) {
-    int oldOff = -(int)(progress * DIGIT_H); // old slides up off the band
-    int newOff = (int)((1.0f - progress) * DIGIT_H); // new slides up into band
-    drawClockChar(CLOCK_X + 3 * DIGIT_W, CLOCK_Y + oldOff, '0' + (oldMin / 10));
-    drawClockChar(CLOCK_X + 4 * DIGIT_W, CLOCK_Y + oldOff, '0' + (oldMin % 10));
-    drawClockChar(CLOCK_X + 3 * DIGIT_W, CLOCK_Y + newOff, '0' + (curMin / 10));
-    drawClockChar(CLOCK_X + 4 * DIGIT_W, CLOCK_Y + newOff, '0' + (curMin % 10));
+    int oldOff = -slideRows;          // old slides up off the band
+    int newOff = DIGIT_H - slideRows; // new slides up into band
+    blitClockGlyph(CLOCK_X + 3 * DIGIT_W, oldOff, '0' + (oldMin / 10));
+    blitClockGlyph(CLOCK_X + 4 * DIGIT_W, oldOff, '0' + (oldMin % 10));
+    blitClockGlyph(CLOCK_X + 3 * DIGIT_W, newOff, '0' + (curMin / 10));
+    blitClockGlyph(CLOCK_X + 4 * DIGIT_W, newOff, '0' + (curMin % 10));
   } else {
-    drawClockChar(CLOCK_X + 3 * DIGIT_W, CLOCK_Y, '0' + (curMin / 10));
-    drawClockChar(CLOCK_X + 4 * DIGIT_W, CLOCK_Y, '0' + (curMin % 10));
+    blitClockGlyph(CLOCK_X + 3 * DIGIT_W, 0, '0' + (curMin / 10));
+    blitClockGlyph(CLOCK_X + 4 * DIGIT_W, 0, '0' + (curMin % 10));
   }
 
-  // Mask digit overflow above and below the clock band so the date row and
-  // T/H row stay clean during the slide animation.
-  display.fillRect(0, 0, SCREEN_WIDTH, CLOCK_Y, SSD1306_BLACK);
-  display.fillRect(0, CLOCK_Y + DIGIT_H, SCREEN_WIDTH,
-                   SCREEN_HEIGHT - (CLOCK_Y + DIGIT_H), SSD1306_BLACK);
-
   // ---- Date row (top) ----
   display.setTextSize(1);
   char dateStr[20];
@@ -1023,7 +2804,7 @@ void displayOverviewClock() {
 
   // ---- T/H row (bottom) ----
   char thStr[24];
-  if (hasLiveData || ramBufferCount > 0) {
+  if (hasLiveData || !recentReadings.empty()) {
     snprintf(thStr, sizeof(thStr), "T:%.1fC  H:%.0f%%", data.temperature,
              data.humidity);
   } else {
@@ -1036,7 +2817,7 @@ void displayOverviewClock() {
   display.setCursor(thX, 56);
   display.print(thStr);
 
-  display.display();
+  oledFlush();
 }
 
 // Dispatcher: pick the active overview sub-page.
@@ -1052,13 +2833,13 @@ void displayHistory() {
   if (!displayAvailable)
     return;
 
-  int totalEntries = flashEntryCount;
+  int totalEntries = historyCount();
   if (totalEntries == 0) {
     display.clearDisplay();
     display.setTextSize(1);
     display.setCursor(20, 28);
     display.print("No history");
-    display.display();
+    oledFlush();
     return;
   }
 
@@ -1067,7 +2848,9 @@ void displayHistory() {
   if (historyIndex >= totalEntries)
     historyIndex = totalEntries - 1;
 
-  SensorData data = getHistoryEntry(historyIndex);
+  SensorData data;
+  if (!historyView.get(historyIndex, data))
+    data = getHistoryEntry(historyIndex);
 
   display.clearDisplay();
   display.setTextSize(1);
@@ -1102,7 +2885,64 @@ void displayHistory() {
   display.print(data.pressure, 0);
   display.print("hPa");
 
-  display.display();
+  oledFlush();
+}
+
+// Settings -> Boot Stats: min/avg/max ms per phase over all stored wakes
+void displayBootStats() {
+  if (!displayAvailable)
+    return;
+
+  display.clearDisplay();
+  display.setTextSize(1);
+  display.setCursor(0, 0);
+  display.printf("Boot ms (%d wakes)", bootProfiles.size());
+
+  const int VISIBLE_ROWS = 5;
+  bootStatsScroll = constrain(bootStatsScroll, 0, PHASE_COUNT - VISIBLE_ROWS);
+  for (int row = 0; row < VISIBLE_ROWS; row++) {
+    int p = bootStatsScroll + row;
+    PhaseStats st = phaseStats(p, WAKE_KIND_COUNT);
+    display.setCursor(0, 11 + row * 9);
+    if (st.runs == 0)
+      display.printf("%-7.7s    --", PHASE_NAMES[p]);
+    else
+      display.printf("%-7.7s%4lu%5lu%5lu", PHASE_NAMES[p],
+                     (unsigned long)(st.minUs / 1000),
+                     (unsigned long)(st.sumUs / st.runs / 1000),
+                     (unsigned long)(st.maxUs / 1000));
+  }
+
+  display.setCursor(0, 57);
+  display.print("min avg max Clk=Back");
+  oledFlush();
+}
+
+// Settings -> Power Budget: estimated charge per wake and battery life at
+// the current Wakeup / Sleep settings
+void displayPowerBudget() {
+  if (!displayAvailable)
+    return;
+
+  PowerBudget b = powerBudget();
+  display.clearDisplay();
+  display.setTextSize(1);
+  display.setCursor(0, 0);
+  display.printf("Power %s/%s", WAKEUP_LABELS[wakeupIntervalIdx],
+                 SLEEP_LABELS[sleepTimeoutIdx]);
+  display.setCursor(0, 11);
+  display.printf("Timer %6.2f mAs", b.timerMas);
+  display.setCursor(0, 20);
+  display.printf("User  %6.1f mAs x%.1f", b.userMas, b.userPerDay);
+  display.setCursor(0, 29);
+  display.printf("NTP   %6.1f mAs", b.ntpMas);
+  display.setCursor(0, 38);
+  display.printf("%.2f mAh/day", b.mAhPerDay);
+  display.setCursor(0, 47);
+  display.printf("Battery ~%.0f days", b.days);
+  display.setCursor(0, 57);
+  display.print("Estimate  Clk=Back");
+  oledFlush();
 }
 
 void displaySettings() {
@@ -1154,6 +2994,12 @@ void displaySettings() {
     case SET_HISTORY:
       display.print(" History");
       break;
+    case SET_BOOT_STATS:
+      display.print(" Boot Stats");
+      break;
+    case SET_POWER:
+      display.print(" Power Budget");
+      break;
     case SET_CLEAR_DATA:
       display.print(" Clear Data");
       break;
@@ -1174,7 +3020,7 @@ void displaySettings() {
   display.setCursor(0, 57);
   display.print("Turn=Nav  Click=Pick");
 
-  display.display();
+  oledFlush();
 }
 
 // Yes/No confirmation prompt for destructive/expensive actions.
@@ -1244,7 +3090,7 @@ void displayConfirm() {
   display.setCursor(SCREEN_WIDTH - (int)strlen(secBuf) * 6 - 2, 56);
   display.print(secBuf);
 
-  display.display();
+  oledFlush();
 }
 
 void displayTimeEdit() {
@@ -1289,89 +3135,267 @@ void displayTimeEdit() {
   display.setCursor(0, 56);
   display.print("Hold: save & exit");
 
-  display.display();
+  oledFlush();
 }
 
-// Get data series for graph based on range and offset (OPTIMIZED)
-void getSeries(float *values, int *count, bool isTemperature, TimeRange range,
-               int offset) {
-  time_t now = rtc.getEpoch();
-  time_t rangeSeconds;
+static void seriesFromRollups(SeriesCacheEntry &e, int tier) {
+  seriesFoldRollupLog(e, rollupLogs[tier]);
 
-  switch (range) {
-  case RANGE_DAILY:
-    rangeSeconds = 86400;
-    break; // 24h
-  case RANGE_WEEKLY:
-    rangeSeconds = 604800;
-    break; // 7d
-  case RANGE_MONTHLY:
-    rangeSeconds = 2592000;
-    break; // 30d
-  case RANGE_YEARLY:
-    rangeSeconds = 31536000;
-    break; // 365d
+  // The still-open period (RTC) holds the most recent readings
+  const RollupRecord &open = rollupOpen[tier];
+  if (open.count > 0 && (time_t)open.periodStart >= e.startTime &&
+      (time_t)open.periodStart <= e.endTime) {
+    seriesFoldRollup(e, open, true);
   }
 
-  time_t startTime = now - rangeSeconds * (offset + 1);
-  time_t endTime = now - rangeSeconds * offset;
+  // Staged readings only reach the rollups when they are flushed
+  for (uint16_t i = 0; i < stagedReadings.size(); i++) {
+    const SensorData &data = stagedReadings[i];
+    if (data.timestamp < e.startTime || data.timestamp > e.endTime)
+      continue;
+    seriesFoldReading(e, data);
+  }
+}
 
-  *count = 0;
+// Fill a cache entry for its window from flash. Single pass: every reading
+// in the window is folded into the bucket (graph column) its timestamp
+// falls in, keeping min/max/mean/count, so short spikes survive the
+// downsampling. Ranges whose columns span an hour or more read the
+// precomputed rollup tier instead of raw readings.
+static void computeSeries(SeriesCacheEntry &e, time_t now) {
+  seriesBegin(e);
 
   // Early exit if no data in range
-  if (flashEntryCount == 0 || endTime < oldestTimestamp ||
-      startTime > newestTimestamp) {
+  if (historyCount() == 0 || e.endTime < oldestTimestamp ||
+      e.startTime > newestTimestamp) {
     return;
   }
 
-  // Estimate entry range using timestamps (assuming roughly even spacing)
-  int estimatedStart = 0;
-  int estimatedEnd = flashEntryCount;
-
-  if (flashEntryCount > 0 && newestTimestamp > oldestTimestamp) {
-    float entriesPerSecond =
-        (float)flashEntryCount / (newestTimestamp - oldestTimestamp);
-    estimatedStart =
-        max(0, (int)((startTime - oldestTimestamp) * entriesPerSecond) - 10);
-    estimatedEnd =
-        min((int)flashEntryCount,
-            (int)((endTime - oldestTimestamp) * entriesPerSecond) + 10);
+  int tier = tierForRange(e.range);
+  // Scrolled back past what a tier's log retains: use the coarser tier
+  while (tier >= 0 && tier < TIER_COUNT - 1 &&
+         now - e.startTime >
+             (time_t)ROLLUP_LOGS[tier].capacity * TIER_SECONDS[tier])
+    tier++;
+  if (tier >= 0 && rollupsValid) {
+    seriesFromRollups(e, tier);
+  } else {
+    // One open file for the whole scan; entries stream in block-sized
+    // chunks. Seek to startTime through the block index, then read until
+    // the window ends (staged entries follow the flash ones).
+    HistoryReader reader(historyLog);
+    uint32_t total = historyCount();
+    uint32_t first = reader.open() ? reader.lowerBound(e.startTime) : 0;
+
+    for (uint32_t i = first; i < total; i++) {
+      SensorData data = getHistoryEntry(i, &reader);
+      if (data.timestamp > e.endTime)
+        break;
+      if (data.timestamp < e.startTime)
+        continue;
+      seriesFoldReading(e, data);
+    }
   }
 
-  // Scan only estimated range
-  int matchingCount = 0;
-  for (int i = estimatedStart; i < estimatedEnd; i++) {
-    SensorData data = getHistoryEntry(i);
-    if (data.timestamp >= startTime && data.timestamp <= endTime) {
-      matchingCount++;
+  seriesEnd(e);
+}
+
+// Get data series for graph based on range and offset. Windows end on a
+// column boundary so "now" only moves them once per column width, which
+// lets recently viewed (range, offset) pairs and the other channels come
+// straight from the LRU cache. logReading() drops windows it lands in.
+// Returns the channel's buckets; filled receives the non-empty count.
+const SeriesBucket *getSeries(SeriesChannel channel, TimeRange range,
+                              int offset, int &filled) {
+  time_t now = rtc.getEpoch();
+  time_t span = rangeSeconds(range);
+  time_t column = span / GRAPH_POINTS;
+  time_t endTime = now - now % column + column - span * offset;
+  time_t startTime = endTime - span;
+  int k = channelSlot(channel);
+  filled = 0;
+  if (!channelEnabled(channel))
+    return seriesCache[0].buckets[0]; // nothing to plot
+
+  SeriesCacheEntry *slot = &seriesCache[0];
+  for (int i = 0; i < SERIES_CACHE_SLOTS; i++) {
+    SeriesCacheEntry &e = seriesCache[i];
+    if (e.valid && e.range == range && e.startTime == startTime) {
+      e.lastUsed = ++seriesCacheClock;
+      filled = e.filled[k];
+      return e.buckets[k];
     }
+    // Reuse an invalid slot, else the least recently used
+    if (slot->valid && (!e.valid || e.lastUsed < slot->lastUsed))
+      slot = &e;
   }
 
-  if (matchingCount == 0)
-    return;
+  slot->range = range;
+  slot->startTime = startTime;
+  slot->endTime = endTime;
+  computeSeries(*slot, now);
+  slot->valid = true;
+  slot->lastUsed = ++seriesCacheClock;
+  filled = slot->filled[k];
+  return slot->buckets[k];
+}
 
-  // Calculate downsample step
-  int maxPoints = 120;
-  int step = max(1, matchingCount / maxPoints);
+// Graph geometry: one column per bucket, plot rows GRAPH_TOP..+HEIGHT-1
+// inside the frame
+#define GRAPH_LEFT 5
+#define GRAPH_TOP 20
+#define GRAPH_HEIGHT 42
+#define GRAPH_LABEL_PAGES 3 // title (page 0), max label (1), min label (7)
+#define GRAPH_LABEL_LEN 22  // "Abs hum 365d (-100y)" and the NUL, one spare
+
+// Drawing straight into an SSD1306-layout frame buffer: W columns by H/8
+// pages, bit k of byte x + p*W is pixel (x, 8p + k). A vertical run is a
+// masked OR per page instead of one drawPixel() per pixel.
+template <int W, int H> struct FrameCanvas {
+  static_assert(H % 8 == 0, "SSD1306 pages are 8 rows");
+  uint8_t *buf;
+
+  void pixel(int x, int y) {
+    if (x >= 0 && x < W && y >= 0 && y < H)
+      buf[x + (y >> 3) * W] |= 1 << (y & 7);
+  }
 
-  // Collect downsampled data
-  int collected = 0;
-  for (int i = estimatedStart; i < estimatedEnd && *count < maxPoints; i++) {
-    if (collected % step != 0) {
-      collected++;
-      continue;
+  void hline(int x0, int x1, int y, int step = 1) {
+    if (y < 0 || y >= H)
+      return;
+    uint8_t *row = buf + (y >> 3) * W;
+    uint8_t bit = 1 << (y & 7);
+    for (int x = max(x0, 0); x <= min(x1, W - 1); x += step)
+      row[x] |= bit;
+  }
+
+  // Rows y0..y1 of column x; pattern thins the run (0x55 / 0xAA keep even /
+  // odd rows)
+  void vspan(int x, int y0, int y1, uint8_t pattern = 0xFF) {
+    if (y0 > y1) {
+      int t = y0;
+      y0 = y1;
+      y1 = t;
     }
+    y0 = max(y0, 0);
+    y1 = min(y1, H - 1);
+    if (x < 0 || x >= W || y0 > y1)
+      return;
+    uint8_t *col = buf + x;
+    int p0 = y0 >> 3;
+    int p1 = y1 >> 3;
+    uint8_t m0 = 0xFF << (y0 & 7);
+    uint8_t m1 = 0xFF >> (7 - (y1 & 7));
+    if (p0 == p1) {
+      col[p0 * W] |= m0 & m1 & pattern;
+      return;
+    }
+    col[p0 * W] |= m0 & pattern;
+    for (int p = p0 + 1; p < p1; p++)
+      col[p * W] |= pattern;
+    col[p1 * W] |= m1 & pattern;
+  }
 
-    SensorData data = getHistoryEntry(i);
-    if (data.timestamp >= startTime && data.timestamp <= endTime) {
-      values[*count] = isTemperature ? data.temperature : data.humidity;
-      (*count)++;
-      collected++;
+  // Line between two points with x0 < x1, filled one column at a time:
+  // each column gets the rows the segment crosses within half a column of
+  // its centre
+  void line(int x0, int y0, int x1, int y1) {
+    int dx2 = 2 * (x1 - x0);
+    int dy = y1 - y0;
+    for (int x = x0; x <= x1; x++) {
+      int t = 2 * (x - x0);
+      int ya = y0 + dy * max(t - 1, 0) / dx2;
+      int yb = y0 + dy * min(t + 1, dx2) / dx2;
+      vspan(x, ya, yb);
     }
   }
+
+  void rect(int x, int y, int w, int h) {
+    hline(x, x + w - 1, y);
+    hline(x, x + w - 1, y + h - 1);
+    vspan(x, y, y + h - 1);
+    vspan(x + w - 1, y, y + h - 1);
+  }
+};
+typedef FrameCanvas<SCREEN_WIDTH, SCREEN_HEIGHT> OledCanvas;
+
+// Per-channel graph style, values in hundredths. Centered channels get a
+// span of at least minSpan around their mean (plus 20% headroom); the
+// others use the data's min/max, padded to minSpan when nearly flat.
+struct ChannelInfo {
+  const char *title;
+  int32_t gridStep;
+  int32_t minSpan;
+  bool centered;
+};
+const ChannelInfo CHANNEL_INFO[SERIES_CHANNELS] = {
+    {"Temp", 50, 200, true},      // 0.5 C grid, mean +-1 C at least
+    {"Humid", 500, 100, false},   // 5 %RH grid
+    {"Press", 500, 400, true},    // 5 hPa grid
+    {"Dew pt", 50, 200, true},    // like temperature
+    {"Abs hum", 100, 200, true},  // 1 g/m3 grid
+};
+
+// Value-to-row mapping in fixed point: values are hundredths, scale is
+// rows per hundredth in Q16, computed once per redraw
+struct GraphScale {
+  int32_t minV;
+  int32_t scaleQ16;
+  // Clamped to the plot rows: with centered scaling a bucket's min or max
+  // can fall outside the window, and must not spill over the title or past
+  // the frame buffer
+  int y(int32_t v) const {
+    int row = GRAPH_TOP + GRAPH_HEIGHT - (int)(((v - minV) * scaleQ16) >> 16);
+    return constrain(row, GRAPH_TOP, GRAPH_TOP + GRAPH_HEIGHT - 1);
+  }
+};
+
+// Text rows of the last graph (title, max and min labels) as rendered by
+// GFX, so scrolling to a window with the same labels copies 3 pages
+// instead of drawing the glyphs again
+struct GraphLabelCache {
+  bool valid;
+  char text[GRAPH_LABEL_PAGES][GRAPH_LABEL_LEN];
+  uint8_t pages[GRAPH_LABEL_PAGES][SCREEN_WIDTH];
+};
+static GraphLabelCache graphLabels;
+static const uint8_t GRAPH_LABEL_PAGE[GRAPH_LABEL_PAGES] = {0, 1, 7};
+
+static int32_t toHundredths(float v) { return (int32_t)lroundf(v * 100.0f); }
+
+// Hundredths as a one-decimal label, rounded like print(v, 1)
+static void formatTenths(char *out, size_t len, int32_t hundredths) {
+  int32_t t = (hundredths >= 0 ? hundredths + 5 : hundredths - 5) / 10;
+  snprintf(out, len, "%s%ld.%ld", t < 0 ? "-" : "", (long)abs(t) / 10,
+           (long)abs(t) % 10);
+}
+
+static void
+drawGraphLabels(const char (&text)[GRAPH_LABEL_PAGES][GRAPH_LABEL_LEN]) {
+  uint8_t *buf = display.getBuffer();
+  bool hit = graphLabels.valid;
+  for (int i = 0; i < GRAPH_LABEL_PAGES && hit; i++)
+    hit = strcmp(graphLabels.text[i], text[i]) == 0;
+  if (hit) {
+    for (int i = 0; i < GRAPH_LABEL_PAGES; i++)
+      memcpy(buf + GRAPH_LABEL_PAGE[i] * SCREEN_WIDTH, graphLabels.pages[i],
+             SCREEN_WIDTH);
+    return;
+  }
+  // Draw on the cleared frame so the captured pages hold only the text
+  for (int i = 0; i < GRAPH_LABEL_PAGES; i++) {
+    display.setCursor(0, GRAPH_LABEL_PAGE[i] * 8);
+    display.print(text[i]);
+  }
+  for (int i = 0; i < GRAPH_LABEL_PAGES; i++) {
+    memcpy(graphLabels.text[i], text[i], sizeof(text[i]));
+    memcpy(graphLabels.pages[i], buf + GRAPH_LABEL_PAGE[i] * SCREEN_WIDTH,
+           SCREEN_WIDTH);
+  }
+  graphLabels.valid = true;
 }
 
-void drawGraph(bool isTemperature) {
+void drawGraph(SeriesChannel channel) {
   if (!displayAvailable)
     return;
 
@@ -1379,116 +3403,101 @@ void drawGraph(bool isTemperature) {
   display.setTextSize(1);
 
   // Title with range info
-  display.setCursor(0, 0);
-  if (isTemperature) {
-    display.print("Temp ");
-  } else {
-    display.print("Humid ");
-  }
-
-  const char *rangeNames[] = {"24h", "7d", "30d", "365d"};
-  display.print(rangeNames[currentRange]);
-
+  static const char *RANGE_NAMES[] = {"24h", "7d", "30d", "365d"};
+  static const char RANGE_UNITS[] = {'d', 'w', 'm', 'y'};
+  char text[GRAPH_LABEL_PAGES][GRAPH_LABEL_LEN];
+  int n = snprintf(text[0], sizeof(text[0]), "%s %s",
+                   CHANNEL_INFO[channel].title, RANGE_NAMES[currentRange]);
   if (timeOffset > 0) {
-    display.print(" (-");
-    display.print(timeOffset);
-    switch (currentRange) {
-    case RANGE_DAILY:
-      display.print("d");
-      break;
-    case RANGE_WEEKLY:
-      display.print("w");
-      break;
-    case RANGE_MONTHLY:
-      display.print("m");
-      break;
-    case RANGE_YEARLY:
-      display.print("y");
-      break;
-    }
-    display.print(")");
+    snprintf(text[0] + n, sizeof(text[0]) - n, " (-%d%c)", timeOffset,
+             RANGE_UNITS[currentRange]);
   }
 
   // Get data
-  float values[120];
-  int count;
-  getSeries(values, &count, isTemperature, currentRange, timeOffset);
+  int filled;
+  const SeriesBucket *buckets =
+      getSeries(channel, currentRange, timeOffset, filled);
 
-  if (count < 2) {
+  if (filled < 2) {
+    display.setCursor(0, 0);
+    display.print(text[0]);
     display.setCursor(10, 28);
     display.print("Not enough data");
-    display.display();
+    oledFlush();
     return;
   }
 
-  // Graph dimensions
-  int graphHeight = 42;
-  int graphTop = 20;
-  int graphWidth = 120;
-  int graphLeft = 5;
-
-  // Find min/max and calculate mean
-  float minVal = values[0];
-  float maxVal = values[0];
-  float sum = 0;
-  for (int i = 0; i < count; i++) {
-    if (values[i] < minVal)
-      minVal = values[i];
-    if (values[i] > maxVal)
-      maxVal = values[i];
-    sum += values[i];
-  }
-  float mean = sum / count;
-
-  // Improved scaling for temperature graph (mean-centered)
-  if (isTemperature) {
-    float dataSpan = maxVal - minVal;
-    float span = max(2.0f, dataSpan * 1.2f);
-
-    minVal = mean - (span / 2.0f);
-    maxVal = mean + (span / 2.0f);
-  } else {
-    // Humidity: use simple min/max with padding
-    if (maxVal - minVal < 0.1) {
-      maxVal = minVal + 1;
-    }
+  // Everything below works in hundredths: the buckets are converted once,
+  // then scaling is a multiply and shift per point
+  const ChannelInfo &info = CHANNEL_INFO[channel];
+  int32_t lo[GRAPH_POINTS], hi[GRAPH_POINTS], mid[GRAPH_POINTS];
+  int32_t minVal = INT32_MAX;
+  int32_t maxVal = INT32_MIN;
+  int64_t sum = 0;
+  int32_t samples = 0;
+  for (int b = 0; b < GRAPH_POINTS; b++) {
+    const SeriesBucket &bk = buckets[b];
+    if (bk.count == 0)
+      continue;
+    lo[b] = toHundredths(bk.minVal);
+    hi[b] = toHundredths(bk.maxVal);
+    mid[b] = toHundredths(bk.mean);
+    minVal = min(minVal, lo[b]);
+    maxVal = max(maxVal, hi[b]);
+    sum += (int64_t)mid[b] * bk.count;
+    samples += bk.count;
   }
+  int32_t mean = (int32_t)(sum / samples);
 
-  // Draw border
-  display.drawRect(graphLeft - 1, graphTop - 1, graphWidth + 2, graphHeight + 2,
-                   SSD1306_WHITE);
-
-  // Draw grid lines (every 0.5 units for temp, 5 for humidity)
-  float gridStep = isTemperature ? 0.5 : 5.0;
-  float firstGrid = ceil(minVal / gridStep) * gridStep;
-  for (float gv = firstGrid; gv < maxVal; gv += gridStep) {
-    int y = graphTop + graphHeight -
-            (int)((gv - minVal) / (maxVal - minVal) * graphHeight);
-    for (int x = graphLeft; x < graphLeft + graphWidth; x += 3) {
-      display.drawPixel(x, y, SSD1306_WHITE);
+  if (info.centered) {
+    int32_t span = max(info.minSpan, (maxVal - minVal) * 6 / 5);
+    minVal = mean - span / 2;
+    maxVal = minVal + span;
+  } else {
+    // Simple min/max with padding
+    if (maxVal - minVal < 10) {
+      maxVal = minVal + info.minSpan;
     }
   }
-
-  // Draw data line
-  for (int i = 0; i < count - 1; i++) {
-    int x1 = graphLeft + (i * graphWidth / count);
-    int x2 = graphLeft + ((i + 1) * graphWidth / count);
-
-    int y1 = graphTop + graphHeight -
-             (int)((values[i] - minVal) / (maxVal - minVal) * graphHeight);
-    int y2 = graphTop + graphHeight -
-             (int)((values[i + 1] - minVal) / (maxVal - minVal) * graphHeight);
-
-    display.drawLine(x1, y1, x2, y2, SSD1306_WHITE);
+  GraphScale sc = {minVal, (GRAPH_HEIGHT << 16) / (maxVal - minVal)};
+
+  // Y-axis labels, then the plot ORed over them
+  formatTenths(text[1], sizeof(text[1]), maxVal);
+  formatTenths(text[2], sizeof(text[2]), minVal);
+  drawGraphLabels(text);
+
+  OledCanvas canvas = {display.getBuffer()};
+  canvas.rect(GRAPH_LEFT - 1, GRAPH_TOP - 1, GRAPH_POINTS + 2, GRAPH_HEIGHT + 2);
+
+  // Draw grid lines
+  int32_t gridStep = info.gridStep;
+  int32_t firstGrid = minVal >= 0 ? (minVal + gridStep - 1) / gridStep * gridStep
+                                  : -(-minVal / gridStep * gridStep);
+  for (int32_t gv = firstGrid; gv < maxVal; gv += gridStep) {
+    canvas.hline(GRAPH_LEFT, GRAPH_LEFT + GRAPH_POINTS - 1, sc.y(gv), 3);
   }
 
-  // Y-axis labels
-  display.setCursor(0, 10);
-  display.print(maxVal, 1);
-  display.setCursor(0, graphTop + graphHeight - 6);
-  display.print(minVal, 1);
+  // Min/max envelope as a dithered band so spikes hidden by the mean stay
+  // visible, then the mean line on top, bridging empty buckets.
+  int prevX = -1;
+  int prevY = 0;
+  for (int b = 0; b < GRAPH_POINTS; b++) {
+    if (buckets[b].count == 0)
+      continue;
+    int x = GRAPH_LEFT + b;
+    if (hi[b] > lo[b]) {
+      int top = sc.y(hi[b]);
+      canvas.vspan(x, top, sc.y(lo[b]), (top & 1) ? 0xAA : 0x55);
+    }
+    int y = sc.y(mid[b]);
+    if (prevX >= 0) {
+      canvas.line(prevX, prevY, x, y);
+    }
+    prevX = x;
+    prevY = y;
+  }
 
-  display.display();
+  oledFlush();
 }
 
 void showStatusMessage(const char *msg, int x = 10, int y = 28,
@@ -1499,14 +3508,44 @@ void showStatusMessage(const char *msg, int x = 10, int y = 28,
   display.setTextSize(1);
   display.setCursor(x, y);
   display.print(msg);
-  display.display();
+  oledFlush();
   if (delayMs > 0)
     delay(delayMs);
 }
 
+// Pick the next timer interval from the last two logged readings. Their
+// change is scaled to one Wakeup interval so a stretched gap doesn't read
+// as fast movement; gaps under half an interval (user wakes) are too noisy
+// to judge and keep the current interval.
+uint32_t nextWakeIntervalS() {
+  const uint32_t base = WAKEUP_OPTIONS_MIN[wakeupIntervalIdx] * 60;
+  uint32_t interval = wakeIntervalS ? wakeIntervalS : base;
+  uint16_t n = recentReadings.size();
+  if (n >= 2) {
+    const SensorData &a = recentReadings[n - 2];
+    const SensorData &b = recentReadings[n - 1];
+    time_t dt = b.timestamp - a.timestamp;
+    if (dt >= (time_t)base / 2) {
+      float scale = (float)base / dt;
+      float dT = fabsf(b.temperature - a.temperature) * scale;
+      float dH = fabsf(b.humidity - a.humidity) * scale;
+      if (dT > 2 * ADAPTIVE_TEMP_DEADBAND || dH > 2 * ADAPTIVE_HUMID_DEADBAND)
+        interval = base / 2;
+      else if (dT <= ADAPTIVE_TEMP_DEADBAND && dH <= ADAPTIVE_HUMID_DEADBAND)
+        interval *= 2;
+      else
+        interval = base;
+    }
+  }
+  wakeIntervalS = constrain(interval, base / 2, base * ADAPTIVE_MAX_STRETCH);
+  return wakeIntervalS;
+}
+
 void enterDeepSleep(bool periodicWakeup = false) {
+  uint32_t intervalS = periodicWakeup ? nextWakeIntervalS() : 0;
   if (periodicWakeup) {
-    Serial.printf("Sleep %s\n", WAKEUP_LABELS[wakeupIntervalIdx]);
+    Serial.printf("Sleep %lum (Wakeup %s)\n", (unsigned long)(intervalS / 60),
+                  WAKEUP_LABELS[wakeupIntervalIdx]);
     backgroundReading = true;
   } else {
     Serial.println("Sleep...");
@@ -1519,18 +3558,321 @@ void enterDeepSleep(bool periodicWakeup = false) {
   }
 
   if (displayAvailable) {
+    oledWaitIdle();
+    I2cBusGuard bus;
     display.ssd1306_command(SSD1306_DISPLAYOFF);
+    setDisplayPower(false);
   }
 
   Wire.end();
   if (periodicWakeup) {
-    esp_sleep_enable_timer_wakeup(WAKEUP_OPTIONS_MIN[wakeupIntervalIdx] * 60ULL * 1000000ULL);
+    uint64_t intervalUs = intervalS * 1000000ULL;
+    esp_sleep_enable_timer_wakeup(intervalUs);
+#if WAKE_STUB_SAMPLES > 0
+    armWakeStub(intervalUs);
+#endif
   }
 
   setupWakeupSources();
+  profileCommit();
   esp_deep_sleep_start();
 }
 
+// ========== Serial Commands ==========
+
+// Line-based console on the USB serial port, polled from loop()
+#define SERIAL_LINE_MAX 64
+#define SERIAL_POLL_MS 50 // idle wait cap while a host may be typing
+
+// ---- History export ----
+// "export csv|bin [from [to [skip]]]" streams the history to the host from
+// loop(), a slice at a time: at most EXPORT_SLICE_MS of work per pass and
+// only as much as the USB TX buffer takes without blocking, so input and
+// the UI stay live. from/to are UTC epochs (0 = open end) located through
+// the block index; skip drops that many records of the selection, so a
+// host can resume after the last record it got. The start line carries the
+// absolute index of the first record; the end line the count and a CRC-32
+// of every payload byte. bin records are 12 bytes little-endian: uint32
+// epoch, then the PackedSample fields as stored on flash (dt always 0).
+#define EXPORT_SLICE_MS 4
+#define EXPORT_CHUNK 256
+#define EXPORT_CSV_MAX 48 // longest CSV line
+
+struct ExportJob {
+  bool active;
+  bool csv;
+  time_t to;
+  uint32_t next; // history index of the next record to encode
+  uint32_t sent; // records encoded so far
+  uint32_t crc;
+  size_t pending; // bytes of buf not yet handed to Serial
+  uint8_t buf[EXPORT_CHUNK];
+};
+
+static ExportJob exportJob;
+static HistoryReader exportReader(historyLog);
+
+static void exportFinish(const char *why) {
+  exportReader.close();
+  exportJob.active = false;
+  if (!exportJob.csv)
+    Serial.println(); // bin payload isn't line-terminated
+  Serial.printf("# end %s count=%lu crc=%08lx\n", why,
+                (unsigned long)exportJob.sent, (unsigned long)exportJob.crc);
+}
+
+static void exportStart(bool csv, time_t from, time_t to, uint32_t skip) {
+  exportReader.close();
+  uint32_t total = historyCount();
+  uint32_t first = 0;
+  if (from > 0) {
+    first = exportReader.open() ? exportReader.lowerBound(from) : 0;
+    while (first < total &&
+           getHistoryEntry(first, &exportReader).timestamp < from)
+      first++; // within one block, or among the staged entries
+  }
+  first = (uint32_t)min<uint64_t>((uint64_t)first + skip, total);
+
+  exportJob.active = true;
+  exportJob.csv = csv;
+  exportJob.to = to;
+  exportJob.next = first;
+  exportJob.sent = 0;
+  exportJob.crc = 0;
+  exportJob.pending = 0;
+  Serial.printf("# export %s first=%lu total=%lu\n", csv ? "csv" : "bin",
+                (unsigned long)first, (unsigned long)total);
+  if (csv) {
+    const char *head = "epoch,temp_c,humidity_pct,pressure_hpa\n";
+    exportJob.pending = strlen(head);
+    memcpy(exportJob.buf, head, exportJob.pending);
+  }
+}
+
+// Encode records into the chunk buffer until it can't take another one.
+// Returns false once the selection is exhausted.
+static bool exportFill() {
+  const size_t need = exportJob.csv ? EXPORT_CSV_MAX : sizeof(ExportRecord);
+  uint32_t total = historyCount();
+  while (exportJob.pending + need <= EXPORT_CHUNK) {
+    if (exportJob.next >= total)
+      return false;
+    SensorData d = getHistoryEntry(exportJob.next, &exportReader);
+    if (exportJob.to > 0 && d.timestamp > exportJob.to)
+      return false;
+    uint8_t *out = exportJob.buf + exportJob.pending;
+    size_t n;
+    if (exportJob.csv) {
+      n = snprintf((char *)out, need, "%lu,%.2f,%.2f,%.1f\n",
+                   (unsigned long)d.timestamp, d.temperature, d.humidity,
+                   d.pressure);
+      n = min(n, need - 1);
+    } else {
+      ExportRecord rec;
+      rec.timestamp = (uint32_t)d.timestamp;
+      rec.sample = packSample(d, rec.timestamp);
+      memcpy(out, &rec, sizeof(rec));
+      n = sizeof(rec);
+    }
+    exportJob.crc = esp_rom_crc32_le(exportJob.crc, out, n);
+    exportJob.pending += n;
+    exportJob.next++;
+    exportJob.sent++;
+  }
+  return true;
+}
+
+void pumpSerialExport() {
+  if (!exportJob.active)
+    return;
+  lastActivityTime = millis(); // an export keeps the device awake
+  int64_t deadline = esp_timer_get_time() + EXPORT_SLICE_MS * 1000;
+  bool more = true;
+  do {
+    if (exportJob.pending == 0) {
+      more = exportFill();
+      if (exportJob.pending == 0) {
+        exportFinish("ok");
+        return;
+      }
+    }
+    int room = Serial.availableForWrite();
+    if (room <= 0)
+      return; // host is behind; resume next pass
+    size_t n = min((size_t)room, exportJob.pending);
+    Serial.write(exportJob.buf, n);
+    memmove(exportJob.buf, exportJob.buf + n, exportJob.pending - n);
+    exportJob.pending -= n;
+    if (!more && exportJob.pending == 0) {
+      exportFinish("ok");
+      return;
+    }
+  } while (esp_timer_get_time() < deadline);
+}
+
+static void handleExportCommand(const char *args) {
+  char kind[8] = "";
+  unsigned long from = 0, to = 0, skip = 0;
+  int n = sscanf(args, "%7s %lu %lu %lu", kind, &from, &to, &skip);
+  bool csv = strcmp(kind, "csv") == 0;
+  if (n < 1 || (!csv && strcmp(kind, "bin") != 0)) {
+    Serial.println("Usage: export csv|bin [from [to [skip]]]");
+    return;
+  }
+  if (exportJob.active)
+    exportFinish("restarted");
+  exportStart(csv, (time_t)from, (time_t)to, skip);
+}
+
+static void handleSerialCommand(char *line) {
+  if (strcmp(line, "stats") == 0) {
+    printBootStats();
+  } else if (strcmp(line, "power") == 0) {
+    printPowerBudget();
+  } else if (strncmp(line, "export ", 7) == 0) {
+    handleExportCommand(line + 7);
+  } else if (strcmp(line, "stop") == 0) {
+    if (exportJob.active)
+      exportFinish("stopped");
+  } else if (strcmp(line, "help") == 0) {
+    Serial.println("Commands: stats, power, export csv|bin [from [to "
+                   "[skip]]], stop, help");
+  } else if (line[0] != '\0') {
+    Serial.printf("Unknown command: %s (try help)\n", line);
+  }
+}
+
+void pollSerialCommands() {
+  static char line[SERIAL_LINE_MAX];
+  static size_t len = 0;
+  while (Serial.available() > 0) {
+    int c = Serial.read();
+    if (c == '\r' || c == '\n') {
+      line[len] = '\0';
+      len = 0;
+      handleSerialCommand(line);
+      lastActivityTime = millis();
+    } else if (len < SERIAL_LINE_MAX - 1) {
+      line[len++] = (char)c;
+    }
+  }
+}
+
+// ========== Idle Scheduling ==========
+
+// While the clock page is sliding, refresh ~30 fps; otherwise once a sec.
+static unsigned long overviewRedrawInterval() {
+  return (currentOverviewPage == OV_CLOCK && minuteSliding) ? 33 : 1000;
+}
+
+// Time left until `interval` has strictly passed since `since` (loop()
+// compares with >, so the deadline is one millisecond later)
+static unsigned long msUntil(unsigned long since, unsigned long interval,
+                             unsigned long now) {
+  unsigned long elapsed = now - since;
+  return elapsed > interval ? 0 : interval + 1 - elapsed;
+}
+
+// Milliseconds until loop() has timed work: the inactivity sleep, the
+// confirm countdown, or the overview's live update / redraw
+static unsigned long nextDeadlineMs() {
+  unsigned long now = millis();
+  unsigned long wait =
+      msUntil(lastActivityTime, SLEEP_OPTIONS_MS[sleepTimeoutIdx], now);
+  if (pendingConfirm != CONFIRM_NONE) {
+    wait = min(wait, msUntil(confirmEnterMs, CONFIRM_TIMEOUT_MS - 1, now));
+    wait = min(wait, msUntil(lastConfirmRedraw, CONFIRM_REDRAW_MS, now));
+  }
+  if (currentMode == MODE_OVERVIEW) {
+    wait = min(wait, msUntil(lastLiveUpdate, LIVE_UPDATE_MS, now));
+    wait = min(wait, msUntil(lastClockRedraw, overviewRedrawInterval(), now));
+  }
+  if (exportJob.active)
+    wait = min(wait, 1UL); // keep feeding the TX buffer
+  return wait;
+}
+
+static bool inputPending() {
+  return buttonPressed || longPress || modeButtonPressed || modeLongPress ||
+         !encoderEvents.empty();
+}
+
+// Light sleep drops the USB-Serial/JTAG link, so stay in plain blocking
+// waits while a host is attached
+static bool lightSleepAllowed() {
+#if ARDUINO_USB_CDC_ON_BOOT
+  return !Serial;
+#else
+  return true;
+#endif
+}
+
+const uint8_t IDLE_WAKE_PINS[] = {ENCODER_CLK_PIN, ENCODER_DT_PIN,
+                                  ENCODER_SW_PIN, MODE_BUTTON_PIN};
+#define IDLE_WAKE_PIN_COUNT (sizeof(IDLE_WAKE_PINS) / sizeof(IDLE_WAKE_PINS[0]))
+
+// GPIO wake from light sleep is level triggered: arm each input for the
+// level opposite to its current one, with its edge interrupt masked so the
+// level can't storm the ISR. On wake the edge interrupts are restored and
+// the ISR of whichever pin changed is replayed, since its edge went by
+// while the interrupt was off.
+static void lightSleepFor(unsigned long ms) {
+  oledWaitIdle();
+  Serial.flush();
+  uint8_t before[IDLE_WAKE_PIN_COUNT];
+  for (size_t i = 0; i < IDLE_WAKE_PIN_COUNT; i++) {
+    gpio_num_t pin = (gpio_num_t)IDLE_WAKE_PINS[i];
+    before[i] = digitalRead(pin);
+    gpio_intr_disable(pin);
+    gpio_wakeup_enable(pin, before[i] ? GPIO_INTR_LOW_LEVEL
+                                      : GPIO_INTR_HIGH_LEVEL);
+  }
+  esp_sleep_enable_gpio_wakeup();
+  esp_sleep_enable_timer_wakeup(ms * 1000ULL);
+  chargeAccount();
+  powerLightSleep = true;
+  esp_light_sleep_start();
+  chargeAccount();
+  powerLightSleep = false;
+  esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TIMER);
+  esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_GPIO);
+
+  for (size_t i = 0; i < IDLE_WAKE_PIN_COUNT; i++) {
+    gpio_wakeup_disable((gpio_num_t)IDLE_WAKE_PINS[i]);
+  }
+  // Back to the edge interrupts setupEncoder() attached
+  for (size_t i = 0; i < IDLE_WAKE_PIN_COUNT; i++) {
+    gpio_set_intr_type((gpio_num_t)IDLE_WAKE_PINS[i], GPIO_INTR_ANYEDGE);
+    gpio_intr_enable((gpio_num_t)IDLE_WAKE_PINS[i]);
+  }
+
+  noInterrupts();
+  if (digitalRead(ENCODER_CLK_PIN) != before[0] ||
+      digitalRead(ENCODER_DT_PIN) != before[1])
+    encoderISR();
+  if (digitalRead(ENCODER_SW_PIN) != before[2])
+    buttonISR();
+  if (digitalRead(MODE_BUTTON_PIN) != before[3])
+    modeButtonISR();
+  interrupts();
+}
+
+// Replaces the busy yield() spin: block until the next deadline or an
+// input ISR, in light sleep when the wait is long enough to pay off
+static void idleUntilNextEvent() {
+  if (inputPending())
+    return;
+  unsigned long wait = nextDeadlineMs();
+  if (wait == 0)
+    return;
+  if (wait >= IDLE_LIGHT_SLEEP_MIN_MS && lightSleepAllowed()) {
+    lightSleepFor(wait);
+    return;
+  }
+  // Serial input doesn't notify, so keep polling it at a human pace
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(min(wait, (unsigned long)SERIAL_POLL_MS)));
+}
+
 // ========== Mode Handlers ==========
 
 void refreshDisplay() {
@@ -1539,7 +3881,7 @@ void refreshDisplay() {
     displayOverview();
     break;
   case MODE_GRAPH:
-    drawGraph(graphShowTemp);
+    drawGraph(graphChannel);
     break;
   case MODE_SETTINGS:
     if (pendingConfirm != CONFIRM_NONE) {
@@ -1548,6 +3890,10 @@ void refreshDisplay() {
       displayTimeEdit();
     } else if (inHistoryView) {
       displayHistory();
+    } else if (inBootStatsView) {
+      displayBootStats();
+    } else if (inPowerView) {
+      displayPowerBudget();
     } else {
       displaySettings();
     }
@@ -1557,9 +3903,34 @@ void refreshDisplay() {
   }
 }
 
+// Steps an encoder event is worth where acceleration applies. The rate is a
+// moving average over a burst of detents in one direction; a pause or a
+// reversal resets it, so fine positioning after a flick is back to one step
+// per detent.
+static int encoderAccelerate(const EncoderEvent &ev) {
+  int8_t dir = ev.steps > 0 ? 1 : -1;
+  uint32_t gap = ev.atMs - lastDetentMs;
+  if (dir != lastDetentDir || gap > ENCODER_ACCEL_WINDOW_MS) {
+    encoderRate = 0;
+  } else {
+    uint16_t rate = 1000 / max(gap, (uint32_t)5); // at most 200 /s
+    encoderRate = (encoderRate * 3 + rate) / 4;
+  }
+  lastDetentMs = ev.atMs;
+  lastDetentDir = dir;
+  int mult = 1;
+  if (encoderRate > ENCODER_ACCEL_MIN_RATE) {
+    int over = encoderRate - ENCODER_ACCEL_MIN_RATE;
+    mult = min(1 + over * over / ENCODER_ACCEL_DIV, ENCODER_ACCEL_MAX);
+  }
+  return ev.steps * mult;
+}
+
 // Encoder rotation: context-dependent navigation.
 // Confirm dialog ignores rotation (Yes/No are picked via the buttons).
-void handleRotation(int delta) {
+// delta is in detents; fastDelta adds velocity acceleration and drives the
+// long scrolls (history entries, graph time offset)
+void handleRotation(int delta, int fastDelta) {
   if (pendingConfirm != CONFIRM_NONE) {
     return;
   }
@@ -1576,7 +3947,7 @@ void handleRotation(int delta) {
     break;
   }
   case MODE_GRAPH:
-    timeOffset -= delta;
+    timeOffset -= fastDelta;
     if (timeOffset < 0)
       timeOffset = 0;
     if (timeOffset > 100)
@@ -1587,12 +3958,15 @@ void handleRotation(int delta) {
     if (inTimeEditMode) {
       adjustTimeEditField(delta);
     } else if (inHistoryView) {
-      historyIndex -= delta;
+      historyIndex -= fastDelta;
       if (historyIndex < 0)
         historyIndex = 0;
-      if (historyIndex >= (int)flashEntryCount)
-        historyIndex = flashEntryCount - 1;
-      Serial.printf("History: %d/%lu\n", historyIndex + 1, flashEntryCount);
+      if (historyIndex >= (int)historyCount())
+        historyIndex = historyCount() - 1;
+      Serial.printf("History: %d/%lu\n", historyIndex + 1,
+                    (unsigned long)historyCount());
+    } else if (inBootStatsView) {
+      bootStatsScroll += delta;
     } else {
       settingsIndex += delta;
       if (settingsIndex < 0)
@@ -1642,6 +4016,14 @@ void handleButtonPress() {
 
   if (currentMode == MODE_SETTINGS && inHistoryView) {
     inHistoryView = false;
+    historyView.close();
+    refreshDisplay();
+    return;
+  }
+
+  if (currentMode == MODE_SETTINGS && (inBootStatsView || inPowerView)) {
+    inBootStatsView = false;
+    inPowerView = false;
     refreshDisplay();
     return;
   }
@@ -1652,17 +4034,19 @@ void handleButtonPress() {
     break;
 
   case MODE_GRAPH: {
-    // Cycle 8 combos: Temp Day -> Week -> Month -> Year ->
-    // Humid Day -> Week -> Month -> Year -> wrap.
+    // Cycle Day -> Week -> Month -> Year per channel, then on to the
+    // next enabled channel (SENSOR_CHANNELS) and wrap.
     if (currentRange == RANGE_YEARLY) {
       currentRange = RANGE_DAILY;
-      graphShowTemp = !graphShowTemp;
+      do {
+        graphChannel = (SeriesChannel)((graphChannel + 1) % SERIES_CHANNELS);
+      } while (!channelEnabled(graphChannel));
     } else {
       currentRange = (TimeRange)(currentRange + 1);
     }
     timeOffset = 0;
     static const char *RANGE_NAMES[] = {"Daily", "Weekly", "Monthly", "Yearly"};
-    Serial.printf("Graph: %s %s\n", graphShowTemp ? "Temp" : "Humid",
+    Serial.printf("Graph: %s %s\n", CHANNEL_INFO[graphChannel].title,
                   RANGE_NAMES[currentRange]);
     break;
   }
@@ -1689,9 +4073,18 @@ void handleButtonPress() {
       break;
     case SET_HISTORY:
       inHistoryView = true;
-      historyIndex = flashEntryCount > 0 ? (int)flashEntryCount - 1 : 0;
+      historyIndex = historyCount() > 0 ? (int)historyCount() - 1 : 0;
       Serial.println("History view: open");
       break;
+    case SET_BOOT_STATS:
+      inBootStatsView = true;
+      bootStatsScroll = 0;
+      printBootStats();
+      break;
+    case SET_POWER:
+      inPowerView = true;
+      printPowerBudget();
+      break;
     case SET_CLEAR_DATA:
       pendingConfirm = CONFIRM_CLEAR_DATA;
       confirmEnterMs = millis();
@@ -1742,7 +4135,9 @@ void handleModeButtonPress() {
     Serial.println("Mode: Graph");
     timeOffset = 0;
     currentRange = RANGE_DAILY;
-    graphShowTemp = true;
+    graphChannel = SERIES_TEMP;
+    while (!channelEnabled(graphChannel))
+      graphChannel = (SeriesChannel)(graphChannel + 1);
     break;
   case MODE_SETTINGS:
     Serial.println("Mode: Settings");
@@ -1750,6 +4145,9 @@ void handleModeButtonPress() {
     settingsScroll = 0;
     inTimeEditMode = false;
     inHistoryView = false;
+    historyView.close();
+    inBootStatsView = false;
+    inPowerView = false;
     pendingConfirm = CONFIRM_NONE;
     break;
   default:
@@ -1770,21 +4168,59 @@ void handleModeLongPress() {
 
 // ========== Setup ==========
 
+// Timer wake with nothing but a sample to take: settings, calibration and
+// the recent-readings cache are all in RTC memory and NTP isn't due, so
+// Serial, Preferences, the encoder, the display and the sensor library are
+// skipped. Does not return.
+static bool fastBackgroundWakeReady() {
+  return settingsCached && bmeCalibValid && recentCacheValid() &&
+         timeIsSane() && !ntpWanted();
+}
+
+static void fastBackgroundWake() {
+  backgroundReading = true;
+  bootProfile.wake = WAKE_TIMER;
+  bootCount++;
+  setCpuClock(40);
+  {
+    PROFILE_SCOPE(PH_SENSOR_INIT);
+    Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN);
+    Wire.setClock(WIRE_SPEED);
+    // Calibration in RTC only says a sensor was there at the last full
+    // boot; one register read confirms it still answers
+    uint8_t id = 0;
+    sensorAvailable = bmeRead(BME280_REG_CHIP_ID, &id, 1) && id == BME280_CHIP_ID;
+  }
+  drainStubSamples();
+  readAndLogSensor();
+  bootProfile.phaseUs[PH_SETUP] = (uint32_t)esp_timer_get_time();
+  enterDeepSleep(true);
+}
+
 void setup() {
   // Determine wakeup cause before any delay so we can gate the USB stall
   esp_sleep_wakeup_cause_t wakeup_reason = esp_sleep_get_wakeup_cause();
+  loopTaskHandle = xTaskGetCurrentTaskHandle(); // setup() and loop() share it
+  wakeChargeKind = chargeBucket =
+      wakeup_reason == ESP_SLEEP_WAKEUP_TIMER ? CHG_TIMER : CHG_USER;
+  if (wakeup_reason == ESP_SLEEP_WAKEUP_TIMER && fastBackgroundWakeReady()) {
+    fastBackgroundWake();
+  }
 
   Serial.begin(115200);
+  {
+    PROFILE_SCOPE(PH_USB_WAIT);
 #if ARDUINO_USB_CDC_ON_BOOT
-  if (wakeup_reason == ESP_SLEEP_WAKEUP_UNDEFINED) {
-    delay(2000); // Only wait for USB enumeration on cold boot / hard reset
-    Serial.flush();
-  }
+    if (wakeup_reason == ESP_SLEEP_WAKEUP_UNDEFINED) {
+      delay(2000); // Only wait for USB enumeration on cold boot / hard reset
+      Serial.flush();
+    }
 #else
-  delay(100);
+    delay(100);
 #endif
+  }
 
-  setCpuFrequencyMhz(80); // Reduce from default 160MHz; saves ~25% active power
+  setCpuClock(80); // Reduce from default 160MHz; saves ~25% active power
 
   // Apply timezone from POSIX TZ string. All localtime_r() / mktime() calls
   // and Arduino's getLocalTime() will use this to compute local time with DST.
@@ -1802,10 +4238,12 @@ void setup() {
   case ESP_SLEEP_WAKEUP_GPIO:
     Serial.println("Wakeup: User interaction");
     backgroundReading = false;
+    bootProfile.wake = WAKE_USER;
     break;
   case ESP_SLEEP_WAKEUP_TIMER:
     Serial.println("Wakeup: Periodic timer");
     backgroundReading = true;
+    bootProfile.wake = WAKE_TIMER;
     break;
   case ESP_SLEEP_WAKEUP_UNDEFINED:
     Serial.println("Wakeup: Power on/Reset");
@@ -1833,6 +4271,11 @@ void setup() {
 
   if (!backgroundReading) {
     initDisplay();
+    // RTC cache intact: draw the last known reading before NTP, the sensor
+    // read, or any flash access
+    if (recentCacheValid()) {
+      displayOverview();
+    }
   }
 
   // WiFi/NTP sync with display status
@@ -1844,10 +4287,10 @@ void setup() {
       display.print("Connecting WiFi...");
       display.setCursor(0, 12);
       display.print(WIFI_SSID);
-      display.display();
+      oledFlush();
     }
     printWiFiStatus();
-    bool ntpSuccess = syncTimeWithNTP();
+    bool ntpSuccess = syncTimeWithNTP(true);
 
     showStatusMessage(ntpSuccess ? "NTP Sync OK!" : "NTP Sync Failed", 0, 28,
                       1000);
@@ -1877,12 +4320,24 @@ void setup() {
   initSensor();
 
   if (backgroundReading) {
-    setCpuFrequencyMhz(40); // Minimal clock for sensor read + flash write
+    setCpuClock(40); // Minimal clock for sensor read + flash write
+  }
+
+  // Recent readings and the staged batch survive deep sleep in RTC memory;
+  // only rebuild from flash when the CRC says they can't be trusted
+  if (!recentCacheValid()) {
+    loadRamBuffer();
   } else {
-    loadRamBuffer(); // RAM buffer only needed for interactive display/graphing
+    LOG("RTC cache valid: %d entries (total: %lu, %d staged)\n",
+        recentReadings.size(), (unsigned long)historyCount(),
+        stagedReadings.size());
   }
 
+  drainStubSamples();
   readAndLogSensor();
+  if (uploadDeferred)
+    uploadAndDisconnect(); // now that the history (and this reading) is in
+  bootProfile.phaseUs[PH_SETUP] = (uint32_t)esp_timer_get_time();
 
   if (backgroundReading) {
     Serial.println("Background complete");
@@ -1892,7 +4347,7 @@ void setup() {
   displayOverview();
 
   lastActivityTime = millis();
-  historyIndex = flashEntryCount > 0 ? flashEntryCount - 1 : 0;
+  historyIndex = historyCount() > 0 ? historyCount() - 1 : 0;
   timeOffset = 0;
   currentMode = MODE_OVERVIEW;
   hasLiveData = false;
@@ -1928,22 +4383,23 @@ void loop() {
     lastActivityTime = millis();
   }
 
-  // Encoder rotation with hysteresis
-  int ticksSnapshot;
-  noInterrupts();
-  ticksSnapshot = encoderTicks;
-  interrupts();
-
-  int deltaTicks = ticksSnapshot - lastProcessedTicks;
-  if (abs(deltaTicks) >= ENCODER_DETENTS_PER_CLICK) {
-    int steps = deltaTicks / ENCODER_DETENTS_PER_CLICK;
-    lastProcessedTicks += steps * ENCODER_DETENTS_PER_CLICK;
+  pollSerialCommands();
+  pumpSerialExport();
+
+  // Encoder rotation: drain every detent queued since the last pass (a slow
+  // redraw or flash read delays them but loses none) and apply them at once
+  EncoderEvent ev;
+  int steps = 0;
+  int fastSteps = 0;
+  while (encoderEvents.pop(ev)) {
+    steps += ev.steps;
+    fastSteps += encoderAccelerate(ev);
+  }
+  if (steps != 0 || fastSteps != 0) {
     encoderPos += steps;
-
-    Serial.printf("[ENC] Ticks: %d, Steps: %+d, Pos: %d\n", ticksSnapshot,
-                  steps, encoderPos);
-
-    handleRotation(steps);
+    Serial.printf("[ENC] Steps: %+d (accel %+d), Pos: %d\n", steps, fastSteps,
+                  encoderPos);
+    handleRotation(steps, fastSteps);
     lastActivityTime = millis();
   }
 
@@ -1955,7 +4411,7 @@ void loop() {
       Serial.println("Confirm: timed out (No)");
       pendingConfirm = CONFIRM_NONE;
       refreshDisplay();
-    } else if (nowMs - lastConfirmRedraw > 200) {
+    } else if (nowMs - lastConfirmRedraw > CONFIRM_REDRAW_MS) {
       lastConfirmRedraw = nowMs;
       refreshDisplay();
     }
@@ -1964,16 +4420,13 @@ void loop() {
   // Live sensor + clock updates in overview mode
   if (currentMode == MODE_OVERVIEW) {
     unsigned long nowMs = millis();
-    if (nowMs - lastLiveUpdate > 5000) {
+    if (nowMs - lastLiveUpdate > LIVE_UPDATE_MS) {
       if (readSensorLive(liveData)) {
         hasLiveData = true;
       }
       lastLiveUpdate = nowMs;
     }
-    // While the clock page is sliding, refresh ~30 fps; otherwise once a sec.
-    unsigned long redrawInterval =
-        (currentOverviewPage == OV_CLOCK && minuteSliding) ? 33 : 1000;
-    if (nowMs - lastClockRedraw > redrawInterval) {
+    if (nowMs - lastClockRedraw > overviewRedrawInterval()) {
       displayOverview();
       lastClockRedraw = nowMs;
     }
@@ -1984,5 +4437,9 @@ void loop() {
     enterDeepSleep(true);
   }
 
-  yield();
+  // Read-ahead for the History view while the frame goes out over I2C
+  if (currentMode == MODE_SETTINGS && inHistoryView && !inputPending())
+    historyView.prefetch();
+
+  idleUntilNextEvent();
 }
@@ -0,0 +1,479 @@
+// Host tests of the history and rollup logs on RamStorage: pio test -e native
+
+#include <HistoryStore.h>
+#include <RamStorage.h>
+#include <Series.h>
+#include <unity.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+// Small logs so rotation shows up within a year of hourly data; the
+// firmware's capacities differ, the mechanics don't
+#define TEST_HISTORY_BLOCKS 100 // 3000 entries
+#define TEST_ROLLUP_RECORDS 2000
+#define T0 1767225600 // 2026-01-01 00:00 UTC
+
+static const LogSpec HISTORY_SPEC = {"/history",           HISTORY_MAGIC,
+                                     HISTORY_VERSION,      sizeof(HistoryBlock),
+                                     TEST_HISTORY_BLOCKS,  0};
+static const LogSpec ROLLUP_SPECS[TIER_COUNT] = {
+    {"/rollup_h", ROLLUP_MAGIC, ROLLUP_VERSION, sizeof(RollupRecord),
+     TEST_ROLLUP_RECORDS, ENABLED_CHANNELS},
+    {"/rollup_d", ROLLUP_MAGIC, ROLLUP_VERSION, sizeof(RollupRecord),
+     TEST_ROLLUP_RECORDS, ENABLED_CHANNELS},
+};
+
+static RamStorage *fs;
+static LogState historyState;
+static SegmentLog *history;
+
+void setUp() {
+  fs = new RamStorage();
+  historyState = {};
+  history = new SegmentLog(*fs, HISTORY_SPEC, historyState);
+}
+
+void tearDown() {
+  delete history;
+  delete fs;
+}
+
+// ---- Synthetic datasets ----
+
+struct Dataset {
+  const char *name;
+  uint32_t count;
+  uint32_t step;      // seconds between readings
+  uint32_t gapEvery;  // readings between gaps, 0 = none
+  uint32_t gapLength; // seconds; > 18 h forces a block to close early
+};
+
+static const Dataset DAY = {"1 day", 144, 600, 0, 0};
+static const Dataset MONTH = {"30 days", 1440, 1800, 0, 0};
+static const Dataset YEAR = {"1 year", 8760, 3600, 0, 0};
+static const Dataset GAPS = {"gaps", 2000, 900, 97, 3 * 86400};
+
+// Values on the packed grid (0.01 °C, 0.01 %RH, 0.1 hPa), so what is read
+// back compares exactly
+static std::vector<SensorData> generate(const Dataset &ds) {
+  std::vector<SensorData> out;
+  time_t t = T0;
+  for (uint32_t i = 0; i < ds.count; i++) {
+    if (ds.gapEvery && i > 0 && i % ds.gapEvery == 0)
+      t += ds.gapLength;
+    SensorData d;
+    d.temperature = roundf(2000.0f + 800.0f * sinf(i * 0.05f)) / 100.0f;
+    d.humidity = roundf(5000.0f + 2000.0f * cosf(i * 0.03f)) / 100.0f;
+    d.pressure = roundf(10130.0f + 150.0f * sinf(i * 0.007f)) / 10.0f;
+    d.timestamp = t;
+    out.push_back(d);
+    t += ds.step;
+  }
+  return out;
+}
+
+static void writeHistory(const std::vector<SensorData> &data, size_t from,
+                         size_t to) {
+  HistoryWriter w(*history);
+  TEST_ASSERT_TRUE(w.open());
+  for (size_t i = from; i < to; i++)
+    TEST_ASSERT_TRUE(w.append(data[i]));
+  TEST_ASSERT_TRUE(w.close());
+}
+
+// Write in flush-sized batches, as the firmware does
+static void writeHistory(const std::vector<SensorData> &data) {
+  for (size_t i = 0; i < data.size(); i += 48)
+    writeHistory(data, i, i + 48 < data.size() ? i + 48 : data.size());
+}
+
+static uint32_t bruteLowerBound(const std::vector<SensorData> &data,
+                                uint32_t offset, time_t t) {
+  for (uint32_t i = offset; i < data.size(); i++) {
+    if (data[i].timestamp >= t)
+      return i - offset;
+  }
+  return data.size() - offset;
+}
+
+static void checkReadsBack(const std::vector<SensorData> &data,
+                           uint32_t offset) {
+  HistoryReader r(*history);
+  TEST_ASSERT_TRUE(r.open());
+  TEST_ASSERT_EQUAL_UINT32(data.size() - offset, r.size());
+  SensorData d;
+  for (uint32_t i = 0; i < r.size(); i++) {
+    TEST_ASSERT_TRUE(r.read(i, d));
+    TEST_ASSERT_EQUAL_INT64(data[offset + i].timestamp, d.timestamp);
+    TEST_ASSERT_FLOAT_WITHIN(0.006f, data[offset + i].temperature,
+                             d.temperature);
+    TEST_ASSERT_FLOAT_WITHIN(0.006f, data[offset + i].humidity, d.humidity);
+    TEST_ASSERT_FLOAT_WITHIN(0.06f, data[offset + i].pressure, d.pressure);
+  }
+  TEST_ASSERT_FALSE(r.read(r.size(), d));
+}
+
+static void checkLowerBound(const std::vector<SensorData> &data,
+                            uint32_t offset) {
+  HistoryReader r(*history);
+  TEST_ASSERT_TRUE(r.open());
+  time_t first = data[offset].timestamp;
+  time_t last = data.back().timestamp;
+  // Exact hits, the gaps between readings and both open ends
+  std::vector<time_t> probes = {first - 86400, first, last, last + 1,
+                                last + 86400};
+  for (uint32_t i = offset; i < data.size(); i += 37) {
+    probes.push_back(data[i].timestamp);
+    probes.push_back(data[i].timestamp + 1);
+    probes.push_back(data[i].timestamp - 1);
+  }
+  for (time_t t : probes) {
+    uint32_t blocks = (r.size() + HISTORY_BLOCK_SAMPLES - 1) /
+                      HISTORY_BLOCK_SAMPLES;
+    uint32_t before = fs->stats.reads;
+    uint32_t got = r.lowerBound(t);
+    TEST_ASSERT_EQUAL_UINT32(bruteLowerBound(data, offset, t), got);
+    // A header per probe plus the one block scanned, never a linear walk
+    uint32_t reads = fs->stats.reads - before;
+    uint32_t bound = 4;
+    for (uint32_t n = blocks; n > 1; n = (n + 1) / 2)
+      bound++;
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(bound, reads);
+  }
+}
+
+// ---- lowerBound / locate ----
+
+static void checkDataset(const Dataset &ds) {
+  std::vector<SensorData> data = generate(ds);
+  writeHistory(data);
+  uint32_t kept = data.size();
+  {
+    HistoryReader r(*history);
+    TEST_ASSERT_TRUE(r.open());
+    kept = r.size();
+  }
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(data.size(), kept);
+  checkReadsBack(data, data.size() - kept);
+  checkLowerBound(data, data.size() - kept);
+}
+
+void test_day_locate() { checkDataset(DAY); }
+void test_month_locate() { checkDataset(MONTH); }
+void test_year_locate() { checkDataset(YEAR); }
+void test_gaps_locate() { checkDataset(GAPS); }
+
+// A clock stepped back closes the block early; entries keep their order of
+// arrival and stay individually addressable
+void test_clock_step_back() {
+  std::vector<SensorData> data = generate(DAY);
+  for (size_t i = 100; i < data.size(); i++)
+    data[i].timestamp -= 7200;
+  writeHistory(data);
+  checkReadsBack(data, 0);
+}
+
+// ---- Rotation ----
+
+void test_rotation_keeps_capacity() {
+  std::vector<SensorData> data = generate(YEAR);
+  writeHistory(data);
+  HistoryReader r(*history);
+  TEST_ASSERT_TRUE(r.open());
+  uint32_t minKept = TEST_HISTORY_BLOCKS * HISTORY_BLOCK_SAMPLES;
+  uint32_t maxKept =
+      (TEST_HISTORY_BLOCKS + history->segmentSlots() + 1) * HISTORY_BLOCK_SAMPLES;
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(minKept, r.size());
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(maxKept, r.size());
+  TEST_ASSERT_TRUE(history->firstSegment() > 0);
+  uint32_t kept = r.size();
+  r.close();
+  checkReadsBack(data, data.size() - kept);
+
+  uint32_t files = 0;
+  fs->list(
+      "/history", [](const char *, uint32_t, void *ctx) { (*(uint32_t *)ctx)++; },
+      &files);
+  // segments + meta + tail
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(history->maxSegments() + 2, files);
+}
+
+// Appends only extend files: no existing byte of a segment changes
+void test_segments_append_only() {
+  std::vector<SensorData> data = generate(MONTH);
+  writeHistory(data, 0, 700);
+  char path[LOG_PATH_MAX];
+  history->segmentPath(0, path);
+  std::vector<uint8_t> before = *fs->file(path);
+  writeHistory(data, 700, data.size());
+  std::vector<uint8_t> after = *fs->file(path);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(before.size(), after.size());
+  TEST_ASSERT_EQUAL_MEMORY(before.data(), after.data(), before.size());
+}
+
+// A cold boot lost the RTC bookkeeping: the rescan finds the same log
+void test_cold_rescan() {
+  std::vector<SensorData> data = generate(YEAR);
+  writeHistory(data);
+  uint32_t first = history->firstSlot();
+  uint32_t end = history->endSlot();
+  historyState.crc = 0;
+  TEST_ASSERT_TRUE(history->mount());
+  TEST_ASSERT_EQUAL_UINT32(first, history->firstSlot());
+  TEST_ASSERT_EQUAL_UINT32(end, history->endSlot());
+
+  LogState fresh = {};
+  SegmentLog again(*fs, HISTORY_SPEC, fresh);
+  TEST_ASSERT_TRUE(again.mount());
+  TEST_ASSERT_EQUAL_UINT32(first, again.firstSlot());
+  TEST_ASSERT_EQUAL_UINT32(end, again.endSlot());
+}
+
+// ---- Tail recovery ----
+
+void test_tail_corrupt() {
+  std::vector<SensorData> data = generate(DAY); // 144 = 4 blocks + 24
+  writeHistory(data);
+  std::vector<uint8_t> *tail = fs->file("/history/tail");
+  TEST_ASSERT_NOT_NULL(tail);
+  (*tail)[sizeof(HistoryBlockHeader) + 3] ^= 0x40;
+
+  uint32_t logged = data.size() / HISTORY_BLOCK_SAMPLES * HISTORY_BLOCK_SAMPLES;
+  {
+    HistoryReader r(*history);
+    TEST_ASSERT_TRUE(r.open());
+    TEST_ASSERT_EQUAL_UINT32(logged, r.size());
+  }
+  HistoryWriter w(*history);
+  TEST_ASSERT_TRUE(w.open());
+  TEST_ASSERT_TRUE(w.trimmedTail());
+  TEST_ASSERT_EQUAL_UINT8(data.size() - logged, w.trimmedEntries());
+  SensorData next = data.back();
+  next.timestamp += 600;
+  TEST_ASSERT_TRUE(w.append(next));
+  TEST_ASSERT_TRUE(w.close());
+
+  std::vector<SensorData> expect(data.begin(), data.begin() + logged);
+  expect.push_back(next);
+  checkReadsBack(expect, 0);
+}
+
+// A flush sealed the tail into the log but was cut off before replacing the
+// tail file: the old tail repeats logged entries and must be ignored
+void test_tail_stale() {
+  std::vector<SensorData> data = generate(DAY);
+  writeHistory(data, 0, 100); // 3 blocks + 10 in the tail
+  std::vector<uint8_t> oldTail = *fs->file("/history/tail");
+  writeHistory(data, 100, 125); // seals block 4, tail holds 5
+  *fs->file("/history/tail") = oldTail;
+
+  std::vector<SensorData> logged(data.begin(), data.begin() + 120);
+  checkReadsBack(logged, 0);
+
+  std::vector<SensorData> more(data.begin() + 125, data.end());
+  HistoryWriter w(*history);
+  TEST_ASSERT_TRUE(w.open());
+  TEST_ASSERT_FALSE(w.trimmedTail());
+  for (const SensorData &d : more)
+    TEST_ASSERT_TRUE(w.append(d));
+  TEST_ASSERT_TRUE(w.close());
+  logged.insert(logged.end(), more.begin(), more.end());
+  checkReadsBack(logged, 0);
+}
+
+// An append cut off mid-slot leaves a fragment; the next writer repairs
+// the segment before appending after it
+void test_partial_slot() {
+  std::vector<SensorData> data = generate(MONTH);
+  writeHistory(data, 0, 600);
+  char path[LOG_PATH_MAX];
+  history->segmentPath((history->endSlot() - 1) / history->segmentSlots(), path);
+  std::vector<uint8_t> *seg = fs->file(path);
+  TEST_ASSERT_NOT_NULL(seg);
+  seg->insert(seg->end(), 100, 0xA5);
+  historyState.crc = 0;
+
+  TEST_ASSERT_TRUE(history->mount());
+  TEST_ASSERT_TRUE(history->partial());
+  writeHistory(data, 600, data.size());
+  TEST_ASSERT_FALSE(history->partial());
+  TEST_ASSERT_EQUAL_UINT32(0, fs->file(path)->size() % sizeof(HistoryBlock));
+  checkReadsBack(data, 0);
+}
+
+// The partition filled up mid-batch: what was written stays readable and
+// in sequence
+void test_full_partition() {
+  std::vector<SensorData> data = generate(MONTH);
+  writeHistory(data, 0, 300);
+  fs->failAfterBytes = 0;
+  {
+    HistoryWriter w(*history);
+    if (w.open()) {
+      for (size_t i = 300; i < 400; i++)
+        w.append(data[i]);
+      w.close();
+    }
+  }
+  fs->failAfterBytes = -1;
+  HistoryReader r(*history);
+  TEST_ASSERT_TRUE(r.open());
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(400, r.size());
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(270, r.size());
+  SensorData d;
+  for (uint32_t i = 0; i < r.size(); i++) {
+    TEST_ASSERT_TRUE(r.read(i, d));
+    TEST_ASSERT_EQUAL_INT64(data[i].timestamp, d.timestamp);
+  }
+  r.close();
+  TEST_ASSERT_EQUAL_INT(0, fs->openCount());
+}
+
+// ---- Rollups and series ----
+
+struct Rollups {
+  LogState state[TIER_COUNT] = {};
+  RollupRecord open[TIER_COUNT] = {};
+};
+
+static void buildRollups(const std::vector<SensorData> &data, Rollups &ru) {
+  SegmentLog logs[TIER_COUNT] = {{*fs, ROLLUP_SPECS[0], ru.state[0]},
+                                 {*fs, ROLLUP_SPECS[1], ru.state[1]}};
+  LogWriter out[TIER_COUNT];
+  for (int t = 0; t < TIER_COUNT; t++)
+    TEST_ASSERT_TRUE(out[t].open(logs[t]));
+  for (const SensorData &d : data) {
+    for (int t = 0; t < TIER_COUNT; t++) {
+      RollupRecord done;
+      if (rollupAdd(ru.open[t], t, d, done))
+        TEST_ASSERT_TRUE(out[t].append(&done));
+    }
+  }
+  for (int t = 0; t < TIER_COUNT; t++)
+    out[t].close();
+}
+
+// Every reading folded into the column its rollup period starts in, which
+// is where the rollup path files it
+static void bruteSeries(const std::vector<SensorData> &data, int tier,
+                        SeriesCacheEntry &e) {
+  seriesBegin(e);
+  for (const SensorData &d : data) {
+    time_t period = d.timestamp - d.timestamp % TIER_SECONDS[tier];
+    if (period < e.startTime || period > e.endTime)
+      continue;
+    SensorData at = d;
+    at.timestamp = period;
+    seriesFoldReading(e, at);
+  }
+  seriesEnd(e);
+}
+
+static void checkSeries(const std::vector<SensorData> &data, TimeRange range,
+                        time_t end) {
+  Rollups ru;
+  buildRollups(data, ru);
+  int tier = tierForRange(range);
+  TEST_ASSERT_TRUE(tier >= 0);
+  SegmentLog log(*fs, ROLLUP_SPECS[tier], ru.state[tier]);
+
+  static SeriesCacheEntry got, want;
+  got.startTime = want.startTime = end - rangeSeconds(range);
+  got.endTime = want.endTime = end;
+  seriesBegin(got);
+  fs->stats = {};
+  seriesFoldRollupLog(got, log);
+  if (ru.open[tier].count > 0 &&
+      (time_t)ru.open[tier].periodStart >= got.startTime &&
+      (time_t)ru.open[tier].periodStart <= got.endTime)
+    seriesFoldRollup(got, ru.open[tier], true);
+  seriesEnd(got);
+  // The window's periods plus the binary search, nothing like the whole log
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(
+      rangeSeconds(range) / TIER_SECONDS[tier] + 2 * 12, fs->stats.records);
+
+  bruteSeries(data, tier, want);
+  for (int k = 0; k < ENABLED_CHANNEL_COUNT; k++) {
+    TEST_ASSERT_EQUAL_INT(want.filled[k], got.filled[k]);
+    for (int b = 0; b < GRAPH_POINTS; b++) {
+      const SeriesBucket &w = want.buckets[k][b];
+      const SeriesBucket &g = got.buckets[k][b];
+      TEST_ASSERT_EQUAL_UINT16(w.count, g.count);
+      if (w.count == 0)
+        continue;
+      TEST_ASSERT_EQUAL_FLOAT(w.minVal, g.minVal);
+      TEST_ASSERT_EQUAL_FLOAT(w.maxVal, g.maxVal);
+      TEST_ASSERT_FLOAT_WITHIN(0.01f * fabsf(w.mean) + 0.01f, w.mean, g.mean);
+    }
+  }
+}
+
+void test_tiers() {
+  TEST_ASSERT_EQUAL_INT(-1, tierForRange(RANGE_DAILY));
+  TEST_ASSERT_EQUAL_INT(TIER_HOURLY, tierForRange(RANGE_WEEKLY));
+  TEST_ASSERT_EQUAL_INT(TIER_HOURLY, tierForRange(RANGE_MONTHLY));
+  TEST_ASSERT_EQUAL_INT(TIER_DAILY, tierForRange(RANGE_YEARLY));
+}
+
+void test_series_month() {
+  std::vector<SensorData> data = generate(MONTH);
+  checkSeries(data, RANGE_MONTHLY, data.back().timestamp);
+}
+
+void test_series_year() {
+  std::vector<SensorData> data = generate(YEAR);
+  checkSeries(data, RANGE_YEARLY, data.back().timestamp);
+  // Inside what the hourly tier still retains after rotation
+  checkSeries(data, RANGE_WEEKLY, T0 + 340 * 86400);
+}
+
+void test_series_gaps() {
+  std::vector<SensorData> data = generate(GAPS);
+  checkSeries(data, RANGE_WEEKLY, T0 + 10 * 86400);
+  checkSeries(data, RANGE_MONTHLY, data.back().timestamp);
+}
+
+// Rotation drops whole segments of periods, oldest first, and keeps them
+// in order for the binary search
+void test_rollup_rotation() {
+  std::vector<SensorData> data = generate(YEAR);
+  Rollups ru;
+  buildRollups(data, ru);
+  SegmentLog log(*fs, ROLLUP_SPECS[TIER_HOURLY], ru.state[TIER_HOURLY]);
+  RecordReader<RollupRecord> r(log);
+  TEST_ASSERT_TRUE(r.open());
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(TEST_ROLLUP_RECORDS, r.size());
+  TEST_ASSERT_LESS_THAN_UINT32(data.size(), r.size());
+  RollupRecord prev, rec;
+  TEST_ASSERT_TRUE(r.read(0, prev));
+  for (uint32_t i = 1; i < r.size(); i++) {
+    TEST_ASSERT_TRUE(r.read(i, rec));
+    TEST_ASSERT_EQUAL_UINT32(prev.periodStart + 3600, rec.periodStart);
+    TEST_ASSERT_EQUAL_UINT32(1, rec.count);
+    prev = rec;
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_day_locate);
+  RUN_TEST(test_month_locate);
+  RUN_TEST(test_year_locate);
+  RUN_TEST(test_gaps_locate);
+  RUN_TEST(test_clock_step_back);
+  RUN_TEST(test_rotation_keeps_capacity);
+  RUN_TEST(test_segments_append_only);
+  RUN_TEST(test_cold_rescan);
+  RUN_TEST(test_tail_corrupt);
+  RUN_TEST(test_tail_stale);
+  RUN_TEST(test_partial_slot);
+  RUN_TEST(test_full_partition);
+  RUN_TEST(test_tiers);
+  RUN_TEST(test_series_month);
+  RUN_TEST(test_series_year);
+  RUN_TEST(test_series_gaps);
+  RUN_TEST(test_rollup_rotation);
+  return UNITY_END();
+}
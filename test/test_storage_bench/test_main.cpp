@@ -0,0 +1,173 @@
+// On-target cost of the history paths on LittleFS: a year of synthetic
+// hourly readings in separate /bench_* logs, then cold-cache graph windows
+// for every range and a spread of History-view lookups. Reports records
+// delivered, bytes, read calls and wall time at the current CPU clock.
+//
+//   pio test -e esp32-c3-devkitm-1 -f test_storage_bench
+//
+// Needs a formatted LittleFS partition (flash the firmware once); the
+// device's own history is left alone.
+
+#include <Arduino.h>
+#include <HistoryStore.h>
+#include <LittleFsStorage.h>
+#include <Series.h>
+#include <unity.h>
+
+#include "esp_timer.h"
+
+// The firmware's capacities (src/main.cpp)
+#define BENCH_HISTORY_BLOCKS ((8760 + HISTORY_BLOCK_SAMPLES - 1) / HISTORY_BLOCK_SAMPLES)
+#define BENCH_HOURLY_CAPACITY (24 * 200)
+#define BENCH_DAILY_CAPACITY (366 * 5)
+#define BENCH_READINGS 8760
+#define BENCH_STEP 3600
+#define BENCH_BATCH 48 // readings per flush, as FLASH_BATCH_WAKES stages them
+#define BENCH_END 1798761600 // 2027-01-01 00:00 UTC
+#define BENCH_START (BENCH_END - BENCH_READINGS * BENCH_STEP)
+
+static const LogSpec HISTORY_SPEC = {"/bench_hist",          HISTORY_MAGIC,
+                                     HISTORY_VERSION,        sizeof(HistoryBlock),
+                                     BENCH_HISTORY_BLOCKS,   0};
+static const LogSpec ROLLUP_SPECS[TIER_COUNT] = {
+    {"/bench_h", ROLLUP_MAGIC, ROLLUP_VERSION, sizeof(RollupRecord),
+     BENCH_HOURLY_CAPACITY, ENABLED_CHANNELS},
+    {"/bench_d", ROLLUP_MAGIC, ROLLUP_VERSION, sizeof(RollupRecord),
+     BENCH_DAILY_CAPACITY, ENABLED_CHANNELS},
+};
+
+static LittleFsStorage storage;
+static LogState historyState;
+static LogState rollupState[TIER_COUNT];
+static SegmentLog historyLog(storage, HISTORY_SPEC, historyState);
+static SegmentLog rollupLogs[TIER_COUNT] = {
+    {storage, ROLLUP_SPECS[0], rollupState[0]},
+    {storage, ROLLUP_SPECS[1], rollupState[1]}};
+static RollupRecord rollupOpen[TIER_COUNT];
+static SeriesCacheEntry entry;
+
+void setUp() {}
+void tearDown() {}
+
+static void removeLogs() {
+  historyLog.remove();
+  for (int t = 0; t < TIER_COUNT; t++)
+    rollupLogs[t].remove();
+}
+
+static SensorData reading(uint32_t i) {
+  SensorData d;
+  d.temperature = 20.0f + 8.0f * sinf(i * 0.05f);
+  d.humidity = 50.0f + 20.0f * cosf(i * 0.03f);
+  d.pressure = 1013.0f + 15.0f * sinf(i * 0.007f);
+  d.timestamp = BENCH_START + (time_t)i * BENCH_STEP;
+  return d;
+}
+
+static void report(const char *query, float ms) {
+  char line[80];
+  snprintf(line, sizeof(line), "%-11s %8lu %8lu %6lu %7.1f", query,
+           (unsigned long)storage.stats.records,
+           (unsigned long)storage.stats.bytes,
+           (unsigned long)storage.stats.reads, ms);
+  TEST_MESSAGE(line);
+}
+
+// Written the way the firmware flushes: one writer per batch, rollup
+// periods appended alongside
+void test_build_dataset() {
+  TEST_ASSERT_TRUE_MESSAGE(storage.mount(), "LittleFS not formatted");
+  removeLogs();
+  for (uint32_t i = 0; i < BENCH_READINGS; i += BENCH_BATCH) {
+    HistoryWriter out(historyLog);
+    LogWriter sinks[TIER_COUNT];
+    TEST_ASSERT_TRUE(out.open());
+    for (uint32_t k = i; k < i + BENCH_BATCH && k < BENCH_READINGS; k++) {
+      SensorData d = reading(k);
+      TEST_ASSERT_TRUE(out.append(d));
+      for (int t = 0; t < TIER_COUNT; t++) {
+        RollupRecord done;
+        if (rollupAdd(rollupOpen[t], t, d, done)) {
+          TEST_ASSERT_TRUE(sinks[t].open(rollupLogs[t]));
+          TEST_ASSERT_TRUE(sinks[t].append(&done));
+        }
+      }
+    }
+    TEST_ASSERT_TRUE(out.close());
+  }
+  HistoryReader reader(historyLog);
+  TEST_ASSERT_TRUE(reader.open());
+  TEST_ASSERT_EQUAL_UINT32(BENCH_READINGS, reader.size());
+}
+
+void test_series() {
+  char header[64];
+  snprintf(header, sizeof(header), "query        records    bytes  reads      ms"
+                                   " (%lu MHz)",
+           (unsigned long)getCpuFrequencyMhz());
+  TEST_MESSAGE(header);
+  static const char *RANGE_NAMES[] = {"series 24h", "series 7d", "series 30d",
+                                      "series 365d"};
+  for (int r = RANGE_DAILY; r <= RANGE_YEARLY; r++) {
+    TimeRange range = (TimeRange)r;
+    int tier = tierForRange(range);
+    entry.startTime = BENCH_END - rangeSeconds(range);
+    entry.endTime = BENCH_END;
+    historyLog.forget(); // cold: every wake after a power cycle starts here
+    rollupLogs[0].forget();
+    rollupLogs[1].forget();
+    storage.stats = {};
+    int64_t t0 = esp_timer_get_time();
+    seriesBegin(entry);
+    if (tier >= 0) {
+      seriesFoldRollupLog(entry, rollupLogs[tier]);
+    } else {
+      HistoryReader reader(historyLog);
+      TEST_ASSERT_TRUE(reader.open());
+      SensorData d;
+      for (uint32_t i = reader.lowerBound(entry.startTime);
+           reader.read(i, d) && d.timestamp <= entry.endTime; i++)
+        seriesFoldReading(entry, d);
+    }
+    seriesEnd(entry);
+    report(RANGE_NAMES[r], (esp_timer_get_time() - t0) / 1000.0f);
+
+    // Roughly one record per graph column slice, never the whole history
+    uint32_t period = tier >= 0 ? TIER_SECONDS[tier] : BENCH_STEP;
+    uint32_t expected = rangeSeconds(range) / period;
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(expected + 64, storage.stats.records);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(expected / 8 + 48, storage.stats.reads);
+    uint32_t columns = expected < GRAPH_POINTS ? expected : GRAPH_POINTS;
+    TEST_ASSERT_GREATER_THAN(columns / 2, entry.filled[0]);
+  }
+}
+
+void test_lookups() {
+  const int lookups = 32;
+  HistoryReader reader(historyLog);
+  TEST_ASSERT_TRUE(reader.open());
+  uint32_t total = reader.size();
+  storage.stats = {};
+  int64_t t0 = esp_timer_get_time();
+  SensorData d;
+  for (int i = 0; i < lookups; i++) {
+    uint32_t index = (uint32_t)((uint64_t)total * i / lookups);
+    TEST_ASSERT_TRUE(reader.read(index, d));
+    TEST_ASSERT_EQUAL_INT64(reading(index).timestamp, d.timestamp);
+  }
+  report("entry x32", (esp_timer_get_time() - t0) / 1000.0f);
+  // One block read per lookup at most
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(lookups * 2, storage.stats.reads);
+}
+
+void setup() {
+  delay(2000); // let the USB CDC host attach
+  UNITY_BEGIN();
+  RUN_TEST(test_build_dataset);
+  RUN_TEST(test_series);
+  RUN_TEST(test_lookups);
+  removeLogs();
+  UNITY_END();
+}
+
+void loop() {}